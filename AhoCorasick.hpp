@@ -0,0 +1,227 @@
+/**
+ * @file AhoCorasick.hpp
+ * @author Aviad Dudkevich
+ * @brief Aho-Corasick automaton - find all the occurrences of many scored patterns in a text in
+ * a single pass, ignoring case.
+ */
+#ifndef AHO_CORASICK_HPP
+#define AHO_CORASICK_HPP
+
+#include <cctype>
+#include <string_view>
+#include <vector>
+#include "HashMap.hpp"
+
+/**
+ * AhoCorasick class - a trie of lower case patterns, with a failure link from every node to the
+ * longest proper suffix of its string that is also in the trie. Scanning a text follows trie
+ * edges and falls back on failure links when there is no edge, so every text character is
+ * handled in amortized constant time regardless of how many patterns, or pattern lengths, there
+ * are. Every node keeps the total score of all the patterns that end at it - its own and those
+ * of its suffixes - so the score of all the occurrences that end at a text position is a single
+ * lookup.
+ * Patterns are added with insert(), and build() must be called once after the last of them,
+ * before score().
+ */
+class AhoCorasick
+{
+public:
+    /**
+     * Constructor - an automaton without patterns.
+     */
+    AhoCorasick() : _fail(1, ROOT), _output(1, 0), _parent(1, ROOT), _byte(1, 0), _depth(1, 0)
+    {
+        for (int c = 0; c < ALPHABET_SIZE; ++c)
+        {
+            _fold[c] = (unsigned char) std::tolower(c);
+            _rootNext[c] = ROOT;
+        }
+    }
+
+    /**
+     * Constructor given a range of pairs of (pattern, score). The automaton is built.
+     * @tparam InputIt iterator to pair of a string type and int.
+     * @param first iterator to the first pair.
+     * @param last iterator to after the last pair.
+     */
+    template<typename InputIt>
+    AhoCorasick(InputIt first, InputIt last) : AhoCorasick()
+    {
+        for (; first != last; ++first)
+        {
+            insert(first->first, first->second);
+        }
+        build();
+    }
+
+    /**
+     * Add a pattern. If it was already added, the scores are summed.
+     * @param pattern the pattern, it is searched ignoring case.
+     * @param score the score of every occurrence of the pattern.
+     */
+    void insert(const std::string_view &pattern, const int &score)
+    {
+        int node = ROOT;
+        for (const char c: pattern)
+        {
+            const unsigned char byte = _fold[(unsigned char) c];
+            const int child = (int) _fail.size();
+            const auto added = _transitions.try_emplace(_key(node, byte), child);
+            if (added.second)
+            {
+                _fail.push_back(ROOT);
+                _output.push_back(0);
+                _parent.push_back(node);
+                _byte.push_back(byte);
+                _depth.push_back(_depth[node] + 1);
+            }
+            node = added.first->second;
+        }
+        _output[node] += score;
+    }
+
+    /**
+     * Compute the failure links and the total scores. Nodes are handled by increasing depth, so
+     * the failure link of the parent of a node, and the total score of the node its failure link
+     * points to, are always ready.
+     */
+    void build()
+    {
+        for (const auto &transition: _transitions)
+        {
+            if (transition.first < ALPHABET_SIZE) // edges of the root have keys 0..255.
+            {
+                _rootNext[transition.first] = transition.second;
+            }
+        }
+        for (const int node: _nodesByDepth())
+        {
+            const int parent = _parent[node];
+            if (parent != ROOT)
+            {
+                _fail[node] = _next(_fail[parent], _byte[node]);
+                _output[node] += _output[_fail[node]];
+            }
+        }
+        // the build data is not needed for scanning.
+        std::vector<int>().swap(_parent);
+        std::vector<unsigned char>().swap(_byte);
+        std::vector<int>().swap(_depth);
+    }
+
+    /**
+     * Sum the scores of all the pattern occurrences in a text, overlapping ones included.
+     * @param text the text to scan.
+     * @return the total score.
+     */
+    int score(const std::string_view &text) const
+    {
+        int state = ROOT;
+        return score(text, state);
+    }
+
+    /**
+     * Sum the scores of all the pattern occurrences in a part of a text - the scan goes on from
+     * the state the previous part ended in, so a text can be scored part by part, and
+     * occurrences that cross the parts are found too.
+     * @param text the part of the text to scan.
+     * @param state the state after the previous part (0 before the first part) - it is updated
+     * to the state after this part.
+     * @return the total score of the occurrences that end in this part.
+     */
+    int score(const std::string_view &text, int &state) const
+    {
+        int result = 0;
+        for (const char c: text)
+        {
+            state = _next(state, _fold[(unsigned char) c]);
+            result += _output[state];
+        }
+        return result;
+    }
+
+    /**
+     * @return the number of trie nodes, the root included.
+     */
+    inline long size() const
+    { return (long) _fail.size(); }
+
+    /**
+     * @return true if there are no patterns.
+     */
+    inline bool empty() const
+    { return _fail.size() == 1; }
+
+private:
+    static constexpr int ROOT = 0;
+    static constexpr int ALPHABET_SIZE = 256;
+
+    // trie edges - the key is the node and the byte of the edge, the value is the child node.
+    FlatHashMap<long, int, FastHash<long>> _transitions;
+    int _rootNext[ALPHABET_SIZE]; // edges of the root - it is visited on most text characters.
+    unsigned char _fold[ALPHABET_SIZE]; // lower case of every byte.
+    std::vector<int> _fail; // failure link of every node.
+    std::vector<int> _output; // total score of the patterns that end at every node.
+    std::vector<int> _parent; // parent of every node - only until build().
+    std::vector<unsigned char> _byte; // the byte of the edge from the parent - only until build().
+    std::vector<int> _depth; // length of the string of every node - only until build().
+
+    /**
+     * @param node trie node.
+     * @param byte lower case byte.
+     * @return the key of the edge in _transitions.
+     */
+    inline static long _key(const int &node, const unsigned char &byte)
+    { return ((long) node << 8) | byte; }
+
+    /**
+     * The transition of the automaton - follow failure links until there is an edge with the
+     * byte, or the root has no such edge either.
+     * @param state current node.
+     * @param byte lower case byte.
+     * @return the next node.
+     */
+    int _next(int state, const unsigned char &byte) const
+    {
+        while (state != ROOT)
+        {
+            const auto edge = _transitions.find(_key(state, byte));
+            if (edge != _transitions.end())
+            {
+                return edge->second;
+            }
+            state = _fail[state];
+        }
+        return _rootNext[byte];
+    }
+
+    /**
+     * @return all the nodes except the root, sorted by depth (counting sort).
+     */
+    std::vector<int> _nodesByDepth() const
+    {
+        int maxDepth = 0;
+        for (const int depth: _depth)
+        {
+            maxDepth = depth > maxDepth ? depth : maxDepth;
+        }
+        std::vector<int> start(maxDepth + 2, 0);
+        for (const int depth: _depth)
+        {
+            ++start[depth + 1];
+        }
+        for (int depth = 1; depth <= maxDepth + 1; ++depth)
+        {
+            start[depth] += start[depth - 1];
+        }
+        std::vector<int> nodes(_depth.size());
+        for (int node = 0; node < (int) _depth.size(); ++node)
+        {
+            nodes[start[_depth[node]]++] = node;
+        }
+        nodes.erase(nodes.begin()); // the root is the only node of depth 0.
+        return nodes;
+    }
+};
+
+#endif //AHO_CORASICK_HPP
@@ -0,0 +1,203 @@
+/**
+ * @file Arena.hpp
+ * @author Aviad Dudkevich
+ * @brief Monotonic memory arena, and an allocator that takes its memory from one, so a whole
+ * HashMap can be built in an arena and freed at once.
+ */
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+
+// Constants
+const std::size_t DEFAULT_ARENA_BLOCK_SIZE = 64 * 1024;
+
+/**
+ * Arena class - monotonic memory arena. Memory is handed out from big blocks by moving a pointer
+ * forward, deallocate() does nothing, and all the blocks are freed together by the destructor
+ * (or by release()). A block that is too small for a request is left as it is, and a new one is
+ * allocated - a single big request gets a block of its own.
+ */
+class Arena
+{
+public:
+    /**
+     * Constructor given the size of the blocks.
+     * @param blockSize the minimal size in bytes of every block the arena allocates.
+     */
+    explicit Arena(const std::size_t &blockSize = DEFAULT_ARENA_BLOCK_SIZE) :
+            _blockSize(blockSize), _blocks(nullptr), _current(nullptr), _end(nullptr), _used(0)
+    {}
+
+    Arena(const Arena &other) = delete;
+
+    Arena &operator=(const Arena &other) = delete;
+
+    /**
+     * Destructor - free all the blocks.
+     */
+    ~Arena()
+    {
+        release();
+    }
+
+    /**
+     * Allocate aligned memory. Throws bad_alloc if there is no memory for a new block.
+     * @param bytes the number of bytes.
+     * @param alignment a power of 2.
+     * @return pointer to the memory.
+     */
+    void *allocate(const std::size_t &bytes, const std::size_t &alignment)
+    {
+        char *begin = _align(_current, alignment);
+        if (_current == nullptr || (std::size_t) (begin - _current) + bytes >
+                                   (std::size_t) (_end - _current))
+        {
+            _addBlock(bytes + alignment);
+            begin = _align(_current, alignment);
+        }
+        _current = begin + bytes;
+        _used += bytes;
+        return begin;
+    }
+
+    /**
+     * Free all the blocks. Everything allocated from the arena is invalid after that.
+     */
+    void release()
+    {
+        while (_blocks != nullptr)
+        {
+            Block *next = _blocks->next;
+            ::operator delete(_blocks);
+            _blocks = next;
+        }
+        _current = _end = nullptr;
+        _used = 0;
+    }
+
+    /**
+     * @return the number of bytes allocated from the arena since it was created or released.
+     */
+    inline std::size_t used() const
+    { return _used; }
+
+private:
+    /**
+     * Header of every block - the blocks are kept in a linked list.
+     */
+    struct Block
+    {
+        Block *next;
+    };
+
+    std::size_t _blockSize; // the minimal size of a new block.
+    Block *_blocks; // the last block, that points to the ones before it.
+    char *_current, *_end; // the free memory of the last block.
+    std::size_t _used; // the number of bytes handed out.
+
+    /**
+     * @param pointer pointer to memory, or nullptr.
+     * @param alignment a power of 2.
+     * @return the first address from pointer with that alignment.
+     */
+    inline static char *_align(char *pointer, const std::size_t &alignment)
+    {
+        const std::uintptr_t address = reinterpret_cast<std::uintptr_t>(pointer);
+        return pointer + ((alignment - (address & (alignment - 1))) & (alignment - 1));
+    }
+
+    /**
+     * Allocate a new block, and make it the current one.
+     * @param bytes the number of bytes the block must have room for.
+     */
+    void _addBlock(const std::size_t &bytes)
+    {
+        const std::size_t size = sizeof(Block) + (bytes > _blockSize ? bytes : _blockSize);
+        Block *block = static_cast<Block *>(::operator new(size));
+        block->next = _blocks;
+        _blocks = block;
+        _current = reinterpret_cast<char *>(block) + sizeof(Block);
+        _end = reinterpret_cast<char *>(block) + size;
+    }
+};
+
+/**
+ * ArenaAllocator class - std allocator that takes memory from an Arena. Copies share the arena,
+ * so every container built with the allocator is freed with it. The arena must outlive them.
+ * @tparam T the type to allocate.
+ */
+template<typename T>
+class ArenaAllocator
+{
+public:
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_copy_assignment;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    /**
+     * Constructor given an arena.
+     * @param arena reference to the Arena to allocate from.
+     */
+    ArenaAllocator(Arena &arena) noexcept : _arena(&arena)
+    {}
+
+    /**
+     * Copy constructor from an allocator of another type, for the same arena.
+     * @param other ArenaAllocator of another type.
+     */
+    template<typename U>
+    ArenaAllocator(const ArenaAllocator<U> &other) noexcept : _arena(&other.arena())
+    {}
+
+    /**
+     * @param count the number of objects.
+     * @return pointer to uninitialized memory for count objects.
+     */
+    inline T *allocate(const std::size_t &count)
+    { return static_cast<T *>(_arena->allocate(count * sizeof(T), alignof(T))); }
+
+    /**
+     * Does nothing - the memory returns to the system with the arena.
+     * @param pointer ignored.
+     * @param count ignored.
+     */
+    inline void deallocate(T *pointer, const std::size_t &count) noexcept
+    {
+        (void) pointer;
+        (void) count;
+    }
+
+    /**
+     * @return the arena of the allocator.
+     */
+    inline Arena &arena() const noexcept
+    { return *_arena; }
+
+    /**
+     * compare operator.
+     * @param other another ArenaAllocator.
+     * @return true if both allocate from the same arena - one can free what the other allocated.
+     */
+    template<typename U>
+    inline bool operator==(const ArenaAllocator<U> &other) const noexcept
+    { return _arena == &other.arena(); }
+
+    /**
+     * compare operator.
+     * @param other another ArenaAllocator.
+     * @return false if both allocate from the same arena, true otherwise.
+     */
+    template<typename U>
+    inline bool operator!=(const ArenaAllocator<U> &other) const noexcept
+    { return !(*this == other); }
+
+private:
+    Arena *_arena; // the arena to allocate from.
+};
+
+#endif //ARENA_HPP
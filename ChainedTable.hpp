@@ -0,0 +1,521 @@
+/**
+ * @file ChainedTable.hpp
+ * @author Aviad Dudkevich
+ * @brief Separate chaining storage engine for HashMap - every bucket is a vector of pairs.
+ */
+#ifndef CHAINED_TABLE_HPP
+#define CHAINED_TABLE_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "HashedEntry.hpp"
+#include "Prefetch.hpp"
+
+/**
+ * ChainedTable class - hash table storage with a heap array of buckets, where every bucket is a
+ * vector of the pairs that hashed to it. A bitmap with a bit for every bucket that is not empty
+ * lets iteration, rehash and copy skip 64 empty buckets at a time, so walking a table that
+ * shrank by erases costs about its number of pairs, not its capacity. The table never changes
+ * its own capacity unless asked to by rehash() - keeping the load factor is the HashMap
+ * responsibility.
+ * @tparam KeyT type argument for generic key.
+ * @tparam ValueT type argument for generic value.
+ * @tparam Hash hash function object for KeyT.
+ * @tparam KeyEqual function object that compares two keys.
+ * @tparam Allocator allocator of pairs - the buckets and the pairs in them are allocated by it.
+ * @tparam CacheHash true to keep the hash value of every key next to its pair.
+ */
+template<typename KeyT, typename ValueT, typename Hash, typename KeyEqual, typename Allocator,
+        bool CacheHash>
+class ChainedTable
+{
+public:
+    typedef std::pair<KeyT, ValueT> value_type;
+    typedef Allocator allocator_type;
+
+    /**
+     * Position of an element in the table - the bucket and the index inside the bucket.
+     */
+    struct Position
+    {
+        long bucket, index;
+
+        inline bool operator==(const Position &other) const
+        { return bucket == other.bucket && index == other.index; }
+
+        inline bool operator!=(const Position &other) const
+        { return !(*this == other); }
+    };
+
+    /**
+     * Constructor given the number of buckets.
+     * @param capacity long, must be a power of 2.
+     * @param allocator the allocator of the table.
+     */
+    explicit ChainedTable(const long &capacity, const Allocator &allocator = Allocator()) :
+            _allocator(allocator), _capacity(capacity), _size(0),
+            _occupied(_words(capacity), 0, WordAllocator(_allocator)),
+            _table(_allocateTable(capacity))
+    {}
+
+    /**
+     * Copy constructor - copy the buckets that are not empty, so the layout is the same as the
+     * other table.
+     * @param other another ChainedTable.
+     */
+    ChainedTable(const ChainedTable &other) :
+            _allocator(std::allocator_traits<BucketAllocator>::
+                       select_on_container_copy_construction(other._allocator)),
+            _capacity(other._capacity), _size(other._size),
+            _occupied(other._occupied, WordAllocator(_allocator)), _table(_allocateTable(_capacity))
+    {
+        try
+        {
+            for (long i = _nextOccupied(0); i < _capacity; i = _nextOccupied(i + 1))
+            {
+                _table[i] = other._table[i];
+            }
+        }
+        catch (...)
+        {
+            _deallocateTable(_table, _capacity);
+            throw;
+        }
+    }
+
+    /**
+     * Move constructor. The other table is left without buckets.
+     * @param other rvalue reference to ChainedTable.
+     */
+    ChainedTable(ChainedTable &&other) noexcept : _allocator(other._allocator),
+                                                  _capacity(other._capacity), _size(other._size),
+                                                  _occupied(std::move(other._occupied)),
+                                                  _table(other._table)
+    {
+        other._table = nullptr;
+        other._capacity = 0;
+        other._size = 0;
+    }
+
+    /**
+     * Destructor.
+     */
+    ~ChainedTable()
+    {
+        _deallocateTable(_table, _capacity);
+    }
+
+    ChainedTable &operator=(const ChainedTable &other) = delete;
+
+    /**
+     * @return the number of buckets.
+     */
+    inline long capacity() const
+    { return _capacity; }
+
+    /**
+     * @return the allocator of the table.
+     */
+    inline Allocator get_allocator() const
+    { return Allocator(_allocator); }
+
+    /**
+     * @return the number of pairs in the table.
+     */
+    inline long size() const
+    { return _size; }
+
+    /**
+     * @param key KeyT value, or a key-like value if Hash is transparent.
+     * @return the hash value of the key.
+     */
+    template<typename K>
+    inline static std::size_t hashOf(const K &key)
+    { return Hash{}(key); }
+
+    /**
+     * Search for the pair with the given key.
+     * @param key KeyT value, or a key-like value comparable to KeyT with KeyEqual.
+     * @param hash the hash value of key.
+     * @return position of the pair, or end() if there is no pair with that key.
+     */
+    template<typename K>
+    Position find(const K &key, const std::size_t &hash) const
+    {
+        const long bucketIndex = _getIndex(hash, _capacity);
+        const Bucket &bucket = _table[bucketIndex];
+        for (long i = 0; i < (long) bucket.size(); ++i)
+        {
+            if (bucket[i].hashMatches(hash) && KeyEqual{}(bucket[i].value.first, key))
+            {
+                return Position{bucketIndex, i};
+            }
+        }
+        return end();
+    }
+
+    /**
+     * Start loading the bucket of the given hash value, so a batch of lookups waits for all its
+     * cache misses at once instead of one after the other.
+     * @param hash hash value of a key.
+     */
+    inline void prefetch(const std::size_t &hash) const
+    { prefetchRead(_table + _getIndex(hash, _capacity)); }
+
+    /**
+     * Search for the pair with the given key, and if it is missing - where to add it.
+     * @param key KeyT value, or a key-like value comparable to KeyT with KeyEqual.
+     * @param hash the hash value of key.
+     * @return the position of the pair and true, or the position for emplaceAt() and false if
+     * there is no pair with that key.
+     */
+    template<typename K>
+    std::pair<Position, bool> findOrPrepareInsert(const K &key, const std::size_t &hash) const
+    {
+        const long bucketIndex = _getIndex(hash, _capacity);
+        const Bucket &bucket = _table[bucketIndex];
+        for (long i = 0; i < (long) bucket.size(); ++i)
+        {
+            if (bucket[i].hashMatches(hash) && KeyEqual{}(bucket[i].value.first, key))
+            {
+                return {Position{bucketIndex, i}, true};
+            }
+        }
+        return {Position{bucketIndex, (long) bucket.size()}, false};
+    }
+
+    /**
+     * Construct a new pair in the table. Assumption: there is no pair with the same key.
+     * @param hash the hash value of the key of the new pair.
+     * @param args arguments for the pair constructor.
+     * @return position of the new pair.
+     */
+    template<typename... Args>
+    inline Position emplace(const std::size_t &hash, Args &&... args)
+    { return emplaceAt(end(), hash, std::forward<Args>(args)...); }
+
+    /**
+     * Construct a new pair in the position returned by findOrPrepareInsert(), without searching
+     * for the bucket again. Assumption: the table didn't change since then.
+     * @param position position returned by findOrPrepareInsert(), or end() to find the bucket.
+     * @param hash the hash value of the key of the new pair.
+     * @param args arguments for the pair constructor.
+     * @return position of the new pair.
+     */
+    template<typename... Args>
+    Position emplaceAt(const Position &position, const std::size_t &hash, Args &&... args)
+    {
+        const long bucketIndex = position == end() ? _getIndex(hash, _capacity) : position.bucket;
+        Bucket &bucket = _table[bucketIndex];
+        bucket.emplace_back(hash, std::forward<Args>(args)...);
+        _occupied[bucketIndex / WORD_BITS] |= _bit(bucketIndex);
+        ++_size;
+        return Position{bucketIndex, (long) bucket.size() - 1};
+    }
+
+    /**
+     * Remove the pair in the given position. The last pair of the bucket is moved to its place,
+     * so the other pairs are not shifted.
+     * @param position position of existing pair.
+     * @return position of the pair after it in iteration order, or end() if it was the last one.
+     */
+    Position erase(const Position &position)
+    {
+        Bucket &bucket = _table[position.bucket];
+        if (position.index != (long) bucket.size() - 1)
+        {
+            bucket[position.index] = std::move(bucket.back());
+        }
+        bucket.pop_back();
+        --_size;
+        if (bucket.empty())
+        {
+            _occupied[position.bucket / WORD_BITS] &= ~_bit(position.bucket);
+        }
+        if (position.index < (long) bucket.size()) // the last pair of the bucket is there now.
+        {
+            return position;
+        }
+        return _getNextBucketPosition(position.bucket + 1);
+    }
+
+    /**
+     * @param position position of existing pair.
+     * @return reference to the pair.
+     */
+    inline value_type &get(const Position &position)
+    { return _table[position.bucket][position.index].value; }
+
+    /**
+     * @param position position of existing pair.
+     * @return const reference to the pair.
+     */
+    inline const value_type &get(const Position &position) const
+    { return _table[position.bucket][position.index].value; }
+
+    /**
+     * @param position position of existing pair.
+     * @return the hash value of the key of the pair.
+     */
+    inline std::size_t hashAt(const Position &position) const
+    { return _table[position.bucket][position.index].hash(Hash{}); }
+
+    /**
+     * @return position of the first pair, or end() if the table is empty.
+     */
+    inline Position begin() const
+    { return _getNextBucketPosition(0); }
+
+    /**
+     * @param position position of existing pair.
+     * @return position of the pair after it, or end() if it is the last one.
+     */
+    inline Position next(Position position) const
+    {
+        if (++position.index < (long) _table[position.bucket].size())
+        {
+            return position;
+        }
+        return _getNextBucketPosition(position.bucket + 1);
+    }
+
+    /**
+     * @return position after the last pair.
+     */
+    inline Position end() const
+    { return Position{_capacity, 0}; }
+
+    /**
+     * @param hash hash value of a key.
+     * @return the number of pairs in the bucket of that hash.
+     */
+    inline long bucketSize(const std::size_t &hash) const
+    { return (long) _table[_getIndex(hash, _capacity)].size(); }
+
+    /**
+     * Erase all pairs, keep the capacity.
+     */
+    void clear()
+    {
+        for (long i = _nextOccupied(0); i < _capacity; i = _nextOccupied(i + 1))
+        {
+            _table[i].clear();
+        }
+        std::fill(_occupied.begin(), _occupied.end(), 0);
+        _size = 0;
+    }
+
+    /**
+     * Move all pairs to a new table with the given capacity. Every new bucket is reserved before
+     * a pair moves, so the moves can't fail on an allocation, and the pairs are copied instead
+     * only if their move constructor may throw - so a failed rehash leaves the table as it was.
+     * @param newCapacity the capacity of the new table, must be a power of 2.
+     */
+    void rehash(const long &newCapacity)
+    {
+        std::vector<std::uint64_t, WordAllocator> newOccupied(_words(newCapacity), 0,
+                                                              WordAllocator(_allocator));
+        const IndexAllocator indexAllocator(_allocator);
+        std::vector<long, IndexAllocator> indices(indexAllocator); // the new bucket of every pair.
+        indices.reserve((std::size_t) _size);
+        // the number of pairs of every new bucket.
+        std::vector<long, IndexAllocator> counts((std::size_t) newCapacity, 0, indexAllocator);
+        for (long i = _nextOccupied(0); i < _capacity; i = _nextOccupied(i + 1))
+        {
+            for (const Entry &entry: _table[i])
+            {
+                indices.push_back(_getIndex(entry.hash(Hash{}), newCapacity));
+                ++counts[indices.back()];
+            }
+        }
+        Bucket *newTable = _allocateTable(newCapacity);
+        try
+        {
+            for (long index = 0; index < newCapacity; ++index)
+            {
+                if (counts[index] != 0)
+                {
+                    newTable[index].reserve((std::size_t) counts[index]);
+                    newOccupied[index / WORD_BITS] |= _bit(index);
+                }
+            }
+            std::size_t pair = 0;
+            for (long i = _nextOccupied(0); i < _capacity; i = _nextOccupied(i + 1))
+            {
+                for (Entry &entry: _table[i])
+                {
+                    newTable[indices[pair++]].push_back(std::move_if_noexcept(entry));
+                }
+            }
+        }
+        catch (...)
+        {
+            _deallocateTable(newTable, newCapacity);
+            throw;
+        }
+        _deallocateTable(_table, _capacity);
+        _table = newTable;
+        _capacity = newCapacity;
+        _occupied.swap(newOccupied);
+    }
+
+    /**
+     * Aid swap of HashMap.
+     * @param first ChainedTable reference.
+     * @param second ChainedTable reference.
+     */
+    friend void swap(ChainedTable &first, ChainedTable &second) noexcept
+    {
+        using std::swap;
+        swap(first._allocator, second._allocator);
+        swap(first._capacity, second._capacity);
+        swap(first._size, second._size);
+        first._occupied.swap(second._occupied);
+        swap(first._table, second._table);
+    }
+
+private:
+    typedef HashedEntry<value_type, CacheHash> Entry;
+    typedef typename std::allocator_traits<Allocator>::template rebind_alloc<Entry> EntryAllocator;
+    typedef std::vector<Entry, EntryAllocator> Bucket;
+    typedef typename std::allocator_traits<Allocator>::template rebind_alloc<Bucket>
+            BucketAllocator;
+    typedef typename std::allocator_traits<Allocator>::template rebind_alloc<std::uint64_t>
+            WordAllocator;
+    typedef typename std::allocator_traits<Allocator>::template rebind_alloc<long> IndexAllocator;
+
+    static const long WORD_BITS = 64;
+
+    BucketAllocator _allocator; // allocates the buckets, and its copies allocate the pairs.
+    long _capacity, _size; // capacity - how many buckets. size - how many pairs in the table.
+    std::vector<std::uint64_t, WordAllocator> _occupied; // a bit for every bucket with pairs.
+    Bucket *_table; // the buckets.
+
+    /**
+     * @param capacity the number of buckets.
+     * @return the number of words of the bitmap of that many buckets.
+     */
+    inline static std::size_t _words(const long &capacity)
+    { return (std::size_t) ((capacity + WORD_BITS - 1) / WORD_BITS); }
+
+    /**
+     * @param bucketIndex index of a bucket.
+     * @return the bit of the bucket in its word of the bitmap.
+     */
+    inline static std::uint64_t _bit(const long &bucketIndex)
+    { return (std::uint64_t) 1 << (bucketIndex % WORD_BITS); }
+
+    /**
+     * @param bucketIndex the bucket to start from.
+     * @return the first bucket that is not empty from the given one, or the capacity.
+     */
+    long _nextOccupied(long bucketIndex) const
+    {
+        if (bucketIndex >= _capacity)
+        {
+            return _capacity;
+        }
+        long word = bucketIndex / WORD_BITS;
+        std::uint64_t bits = _occupied[word] & (~(std::uint64_t) 0 << (bucketIndex % WORD_BITS));
+        while (bits == 0)
+        {
+            if (++word == (long) _occupied.size())
+            {
+                return _capacity;
+            }
+            bits = _occupied[word];
+        }
+        return word * WORD_BITS + _lowestBit(bits);
+    }
+
+    /**
+     * @param bits non zero word.
+     * @return the index of the lowest bit that is on.
+     */
+    inline static long _lowestBit(const std::uint64_t &bits)
+    {
+#if defined(__GNUC__)
+        return __builtin_ctzll(bits);
+#else
+        long i = 0;
+        while (!(bits & ((std::uint64_t) 1 << i)))
+        {
+            ++i;
+        }
+        return i;
+#endif
+    }
+
+    /**
+     * Allocate an array of empty buckets that allocate with the allocator of the table.
+     * @param capacity the number of buckets.
+     * @return pointer to the first bucket.
+     */
+    Bucket *_allocateTable(const long &capacity)
+    {
+        Bucket *table = std::allocator_traits<BucketAllocator>::allocate(_allocator,
+                                                                         (std::size_t) capacity);
+        // an empty vector doesn't allocate, so constructing the buckets can't throw.
+        for (long i = 0; i < capacity; ++i)
+        {
+            ::new(static_cast<void *>(table + i)) Bucket(EntryAllocator(_allocator));
+        }
+        return table;
+    }
+
+    /**
+     * Destroy an array of buckets and free it.
+     * @param table pointer to the first bucket, or nullptr.
+     * @param capacity the number of buckets.
+     */
+    void _deallocateTable(Bucket *table, const long &capacity)
+    {
+        if (table == nullptr)
+        {
+            return;
+        }
+        for (long i = 0; i < capacity; ++i)
+        {
+            table[i].~Bucket();
+        }
+        std::allocator_traits<BucketAllocator>::deallocate(_allocator, table,
+                                                           (std::size_t) capacity);
+    }
+
+    /**
+     * Get index in table by hash value and table size.
+     * @param hash hash value of a key.
+     * @param tableSize long.
+     * @return index in table.
+     */
+    inline static long _getIndex(const std::size_t &hash, const long &tableSize)
+    { return (long) (hash & (tableSize - 1)); }
+
+    /**
+     * Get to the next bucket that is not empty.
+     * @param bucketIndex the bucket to start from.
+     * @return position of the first pair in that bucket, or end().
+     */
+    inline Position _getNextBucketPosition(const long &bucketIndex) const
+    { return Position{_nextOccupied(bucketIndex), 0}; }
+};
+
+/**
+ * Storage policy for HashMap - separate chaining with a vector per bucket.
+ * @tparam CacheHash true to keep the hash value of every key next to its pair.
+ */
+template<bool CacheHash = false>
+struct BasicChainedStorage
+{
+    template<typename KeyT, typename ValueT, typename Hash, typename KeyEqual, typename Allocator>
+    using Table = ChainedTable<KeyT, ValueT, Hash, KeyEqual, Allocator, CacheHash>;
+};
+
+typedef BasicChainedStorage<false> ChainedStorage;
+typedef BasicChainedStorage<true> CachedChainedStorage;
+
+#endif //CHAINED_TABLE_HPP
@@ -0,0 +1,289 @@
+/**
+ * @file ConcurrentHashMap.hpp
+ * @author Aviad Dudkevich
+ * @brief Thread safe HashMap - the keys are partitioned into shards, every shard is a HashMap
+ * with a lock of its own.
+ */
+#ifndef CONCURRENT_HASHMAP_HPP
+#define CONCURRENT_HASHMAP_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "HashMap.hpp"
+
+// Constants
+const long DEFAULT_SHARD_COUNT = 16;
+
+/**
+ * ConcurrentHashMap class - a HashMap that many threads can read and write at once. The keys are
+ * partitioned into a power of 2 number of shards by the high bits of their mixed hash value, and
+ * every shard is a HashMap guarded by a reader-writer lock: lookups of a shard run together,
+ * writes to a shard run alone, and threads that use different shards never wait for each other.
+ * Every shard grows and shrinks on its own, so a resize locks only the shard that resizes.
+ * Values are returned by copy - a reference would outlive the lock. operator[] is replaced by
+ * update(), that changes a value in place under the lock of its shard.
+ * @tparam KeyT type argument for generic key.
+ * @tparam ValueT type argument for generic value, copy constructible.
+ * @tparam Hash, KeyEqual, Allocator, Storage, Resize the policies of the HashMap of every shard.
+ */
+template<typename KeyT, typename ValueT, typename Hash = DefaultHash<KeyT>,
+        typename KeyEqual = std::equal_to<>,
+        typename Allocator = std::allocator<std::pair<KeyT, ValueT>>,
+        typename Storage = ChainedStorage, typename Resize = EagerShrink>
+class ConcurrentHashMap
+{
+public:
+    typedef HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator, Storage, Resize> Shard;
+
+    /**
+     * Constructor given the number of shards.
+     * @param shards the number of shards - rounded up to a power of 2.
+     * @param allocator the allocator of the shards.
+     */
+    explicit ConcurrentHashMap(const long &shards = DEFAULT_SHARD_COUNT,
+                               const Allocator &allocator = Allocator()) : _shardBits(0)
+    {
+        while ((1L << _shardBits) < shards)
+        {
+            ++_shardBits;
+        }
+        for (long i = 0; i < (1L << _shardBits); ++i)
+        {
+            _shards.emplace_back(new LockedShard(allocator));
+        }
+    }
+
+    ConcurrentHashMap(const ConcurrentHashMap &other) = delete;
+
+    ConcurrentHashMap &operator=(const ConcurrentHashMap &other) = delete;
+
+    /**
+     * @return the number of shards.
+     */
+    inline long shardCount() const
+    { return (long) _shards.size(); }
+
+    /**
+     * @return the number of pairs. Pairs that are inserted or erased meanwhile may or may not be
+     * counted.
+     */
+    long size() const
+    {
+        long result = 0;
+        for (const std::unique_ptr<LockedShard> &shard: _shards)
+        {
+            std::shared_lock<std::shared_mutex> lock(shard->mutex);
+            result += shard->map.size();
+        }
+        return result;
+    }
+
+    /**
+     * @return true if there are no pairs, like size() == 0.
+     */
+    inline bool empty() const
+    { return size() == 0; }
+
+    /**
+     * Insert a pair, if the key is not in the map.
+     * @param key KeyT value.
+     * @param value ValueT value.
+     * @return true if the pair was inserted, false if the key is already in the map.
+     */
+    bool insert(const KeyT &key, const ValueT &value)
+    {
+        LockedShard &shard = _shardOf(key);
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        return shard.map.insert(key, value);
+    }
+
+    /**
+     * Insert a pair, or assign the value if the key is already in the map.
+     * @param key KeyT value.
+     * @param value ValueT value.
+     * @return true if the pair was inserted, false if the value was assigned.
+     */
+    bool insert_or_assign(const KeyT &key, const ValueT &value)
+    {
+        LockedShard &shard = _shardOf(key);
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        return shard.map.insert_or_assign(key, value).second;
+    }
+
+    /**
+     * Erase a pair.
+     * @param key KeyT value.
+     * @return true if the pair was erased, false if the key is not in the map.
+     */
+    bool erase(const KeyT &key)
+    {
+        LockedShard &shard = _shardOf(key);
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        return shard.map.erase(key);
+    }
+
+    /**
+     * @param key KeyT value.
+     * @return true if the key is in the map.
+     */
+    bool containsKey(const KeyT &key) const
+    {
+        const LockedShard &shard = _shardOf(key);
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        return shard.map.containsKey(key);
+    }
+
+    /**
+     * @param key KeyT value.
+     * @return a copy of the value of the key. Throw out_of_range exception if the key is not in
+     * the map.
+     */
+    ValueT at(const KeyT &key) const
+    {
+        const LockedShard &shard = _shardOf(key);
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        return shard.map.at(key);
+    }
+
+    /**
+     * Read a value under the lock of its shard, without copying it.
+     * @tparam Function callable with (const ValueT &).
+     * @param key KeyT value.
+     * @param function called with the value of the key, if it is in the map. Must not use this
+     * map.
+     * @return true if the key is in the map.
+     */
+    template<typename Function>
+    bool visit(const KeyT &key, Function function) const
+    {
+        const LockedShard &shard = _shardOf(key);
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        const auto found = shard.map.find(key);
+        if (found == shard.map.end())
+        {
+            return false;
+        }
+        function(found->second);
+        return true;
+    }
+
+    /**
+     * Change a value atomically - no other thread uses the shard of the key meanwhile. A key that
+     * is not in the map is inserted with a default constructed value first, like with
+     * HashMap::operator[].
+     * @tparam Function callable with (ValueT &).
+     * @param key KeyT value.
+     * @param function called with a reference to the value of the key. Must not use this map.
+     * @return what function returns.
+     */
+    template<typename Function>
+    decltype(auto) update(const KeyT &key, Function function)
+    {
+        LockedShard &shard = _shardOf(key);
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        return function(shard.map[key]);
+    }
+
+    /**
+     * Call a function on every pair, a shard at a time - every shard is locked for reading while
+     * its pairs are visited.
+     * @tparam Function callable with (const std::pair<KeyT, ValueT> &).
+     * @param function called with every pair. Must not use this map.
+     */
+    template<typename Function>
+    void forEach(Function function) const
+    {
+        for (const std::unique_ptr<LockedShard> &shard: _shards)
+        {
+            std::shared_lock<std::shared_mutex> lock(shard->mutex);
+            for (const auto &pair: std::as_const(shard->map))
+            {
+                function(pair);
+            }
+        }
+    }
+
+    /**
+     * Make every shard ready for its part of a number of pairs, so they don't grow meanwhile.
+     * @param count the number of pairs of the whole map.
+     */
+    void reserve(const long &count)
+    {
+        const long perShard = count / shardCount() + 1;
+        for (const std::unique_ptr<LockedShard> &shard: _shards)
+        {
+            std::unique_lock<std::shared_mutex> lock(shard->mutex);
+            shard->map.reserve(perShard);
+        }
+    }
+
+    /**
+     * Erase all the pairs.
+     */
+    void clear()
+    {
+        for (const std::unique_ptr<LockedShard> &shard: _shards)
+        {
+            std::unique_lock<std::shared_mutex> lock(shard->mutex);
+            shard->map.clear();
+        }
+    }
+
+private:
+    static constexpr std::size_t CACHE_LINE_SIZE = 64;
+
+    /**
+     * A shard and its lock - on a cache line of its own, so the locks of neighbour shards don't
+     * share a line.
+     */
+    struct alignas(CACHE_LINE_SIZE) LockedShard
+    {
+        explicit LockedShard(const Allocator &allocator) : map(allocator)
+        {}
+
+        mutable std::shared_mutex mutex;
+        Shard map;
+    };
+
+    int _shardBits; // log2 of the number of shards.
+    std::vector<std::unique_ptr<LockedShard>> _shards;
+
+    /**
+     * The shard is picked by the high bits of the mixed hash value - the HashMap of the shard
+     * uses the low bits, and the mixing spreads even hash values that differ only in their low
+     * bits, like the identity hash of small integers.
+     * @param key KeyT value.
+     * @return the index of the shard of the key.
+     */
+    std::size_t _shardIndex(const KeyT &key) const
+    {
+        if (_shardBits == 0)
+        {
+            return 0;
+        }
+        const std::uint64_t mixed = HashFunctions::integer((std::uint64_t) Hash{}(key));
+        return (std::size_t) (mixed >> (64 - _shardBits));
+    }
+
+    /**
+     * @param key KeyT value.
+     * @return the shard of the key.
+     */
+    inline LockedShard &_shardOf(const KeyT &key)
+    { return *_shards[_shardIndex(key)]; }
+
+    /**
+     * @param key KeyT value.
+     * @return the shard of the key.
+     */
+    inline const LockedShard &_shardOf(const KeyT &key) const
+    { return *_shards[_shardIndex(key)]; }
+};
+
+#endif //CONCURRENT_HASHMAP_HPP
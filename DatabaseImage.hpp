@@ -0,0 +1,499 @@
+/**
+ * @file DatabaseImage.hpp
+ * @author Aviad Dudkevich
+ * @brief Compiled binary image of a map from strings to scores - written once, then memory
+ * mapped and searched in place, without parsing or hashing the keys again.
+ */
+#ifndef DATABASE_IMAGE_HPP
+#define DATABASE_IMAGE_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <ostream>
+#include <set>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "FrozenHashMap.hpp"
+#include "HashMapStats.hpp"
+#include "MappedFile.hpp"
+#include "Prefetch.hpp"
+
+// Constants
+static const char DATABASE_IMAGE_MAGIC[8] = {'S', 'P', 'A', 'M', 'D', 'B', '\0', '\0'};
+const std::uint32_t DATABASE_IMAGE_VERSION = 3;
+static const char *DATABASE_IMAGE_HASH_CHECK = "the hash function of the image";
+
+/**
+ * DatabaseImage class - a read-only table of (string, int) pairs with a minimal perfect hash -
+ * the serialized form of a FrozenHashMap - stored as a single file:
+ *     header | slots (size of them) | seeds (buckets of them, padded to 8 bytes) |
+ *     key lengths (lengthCount of them) | key bytes
+ * Every key has a slot of its own, picked by PerfectHash::slot() with the seeds among the first
+ * perfectSlots, so a lookup reads one slot, and compares its key only if the hash value it keeps
+ * matches. Keys with the same hash value as another key are in the slots after those, sorted by
+ * hash value, like in FrozenHashMap - they are searched if the key of the slot isn't equal.
+ * The image is written in the byte order of the machine, and records the hash value of a fixed
+ * string - an image written with a different Hash, or on a machine of another byte order, is
+ * rejected when it is opened.
+ * @tparam Hash the function object that hashed the keys - the same one must be used to search.
+ * @tparam KeyEqual the function object that compares keys.
+ */
+template<typename Hash, typename KeyEqual>
+class DatabaseImage
+{
+    struct Slot;
+
+public:
+    typedef std::pair<std::string_view, int> value_type;
+
+    /**
+     * const_iterator class - iterator over the pairs of the image. The pairs are built on the
+     * fly, so the reference is valid until the iterator moves.
+     */
+    class const_iterator
+    {
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef DatabaseImage::value_type value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const value_type *pointer;
+        typedef const value_type &reference;
+
+        /**
+         * Constructor given an image and a slot in it.
+         * @param image The image to point to its pairs.
+         * @param slot a slot, or the size of the image for the end.
+         */
+        const_iterator(const DatabaseImage &image, const std::uint64_t &slot) : _image(&image),
+                                                                               _slot(slot)
+        { _load(); }
+
+        /**
+         * * operator.
+         * @return dereference to const pair.
+         */
+        inline const value_type &operator*() const
+        { return _pair; }
+
+        /**
+         * -> operator.
+         * @return const address to the pair.
+         */
+        inline const value_type *operator->() const
+        { return &_pair; }
+
+        /**
+         * prefix operator ++.
+         * @return reference to this.
+         */
+        const_iterator &operator++()
+        {
+            ++_slot;
+            _load();
+            return *this;
+        }
+
+        /**
+         * suffix operator ++;
+         * @return reference to const_iterator of the previous pair.
+         */
+        const_iterator operator++(int)
+        {
+            const_iterator temp(*this);
+            operator++();
+            return temp;
+        }
+
+        /**
+         * compare operator.
+         * @param other another const_iterator
+         * @return true if point to the same pair in the same image, false otherwise.
+         */
+        inline bool operator==(const const_iterator &other) const
+        { return _image == other._image && _slot == other._slot; }
+
+        /**
+         * compare operator.
+         * @param other another const_iterator
+         * @return false if point to the same pair in the same image, true otherwise.
+         */
+        inline bool operator!=(const const_iterator &other) const
+        { return !(*this == other); }
+
+    private:
+        const DatabaseImage *_image; // the image the const_iterator belong to.
+        std::uint64_t _slot; // the slot of the pair.
+        value_type _pair; // the pair of the slot.
+
+        /**
+         * Build the pair of the current slot.
+         */
+        void _load()
+        {
+            if (_slot < _image->_size)
+            {
+                _pair = _image->_pairAt(_slot);
+            }
+        }
+    };
+
+    /**
+     * Constructor given the path of an image. Like MappedFile, it doesn't fail - good() tells if
+     * the image was opened and is valid.
+     * @param path the path of the image.
+     */
+    explicit DatabaseImage(const char *path) : _file(path), _slots(nullptr), _seeds(nullptr),
+                                               _lengths(nullptr), _keys(nullptr), _size(0),
+                                               _perfectSlots(0), _buckets(0),
+                                               _lengthCount(0), _good(false)
+    { _good = _file.good() && _open(_file.view()); }
+
+    DatabaseImage(const DatabaseImage &other) = delete;
+
+    DatabaseImage &operator=(const DatabaseImage &other) = delete;
+
+    /**
+     * @param path the path of a file.
+     * @return true if the file starts like an image - it may still be invalid.
+     */
+    static bool isImage(const char *path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        char magic[sizeof(DATABASE_IMAGE_MAGIC)] = {};
+        file.read(magic, sizeof(magic));
+        return file.good() && std::memcmp(magic, DATABASE_IMAGE_MAGIC, sizeof(magic)) == 0;
+    }
+
+    /**
+     * Write an image of a range of pairs. Throws invalid_argument if two keys are equal.
+     * This function can throw bad_alloc exception.
+     * @tparam InputIt iterator to pair of a string type and int.
+     * @param out the binary stream to write to.
+     * @param first iterator to the first pair.
+     * @param last iterator to after the last pair.
+     * @return true if the image was written, false if the stream failed.
+     */
+    template<typename InputIt>
+    static bool write(std::ostream &out, InputIt first, InputIt last)
+    {
+        std::vector<value_type> pairs;
+        std::set<std::size_t> lengths;
+        for (; first != last; ++first)
+        {
+            pairs.emplace_back(std::string_view(first->first), first->second);
+            lengths.emplace(pairs.back().first.size());
+        }
+        const FrozenHashMap<std::string_view, int, Hash, KeyEqual> frozen(pairs.begin(),
+                                                                          pairs.end());
+        std::vector<Slot> slots;
+        slots.reserve(pairs.size());
+        std::vector<char> keys;
+        for (auto pair = frozen.begin(); pair != frozen.end(); ++pair)
+        {
+            slots.push_back(Slot{frozen.hashes()[pair - frozen.begin()], keys.size(),
+                                 (std::uint32_t) pair->first.size(), pair->second});
+            keys.insert(keys.end(), pair->first.begin(), pair->first.end());
+        }
+        std::vector<std::uint32_t> seeds(frozen.seeds());
+        seeds.resize(_padded(seeds.size()), 0);
+        const std::vector<std::uint64_t> lengthList(lengths.begin(), lengths.end());
+        Header header{};
+        std::memcpy(header.magic, DATABASE_IMAGE_MAGIC, sizeof(header.magic));
+        header.version = DATABASE_IMAGE_VERSION;
+        header.slotSize = sizeof(Slot);
+        header.hashCheck = Hash{}(DATABASE_IMAGE_HASH_CHECK);
+        header.size = pairs.size();
+        header.perfectSlots = frozen.perfectSlots();
+        header.buckets = frozen.seeds().size();
+        header.lengthCount = lengthList.size();
+        header.keyBytes = keys.size();
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char *>(slots.data()), slots.size() * sizeof(Slot));
+        out.write(reinterpret_cast<const char *>(seeds.data()),
+                  seeds.size() * sizeof(std::uint32_t));
+        out.write(reinterpret_cast<const char *>(lengthList.data()),
+                  lengthList.size() * sizeof(std::uint64_t));
+        out.write(keys.data(), keys.size());
+        return out.good();
+    }
+
+    /**
+     * @return true if the image was opened and is valid.
+     */
+    inline bool good() const
+    { return _good; }
+
+    /**
+     * @return the number of pairs.
+     */
+    inline long size() const
+    { return (long) _size; }
+
+    /**
+     * @return true if there are no pairs.
+     */
+    inline bool empty() const
+    { return _size == 0; }
+
+    /**
+     * @return all the key lengths, sorted.
+     */
+    std::set<std::size_t> lengths() const
+    {
+        std::set<std::size_t> result;
+        for (std::uint64_t i = 0; i < _lengthCount; ++i)
+        {
+            result.emplace((std::size_t) _lengths[i]);
+        }
+        return result;
+    }
+
+    /**
+     * @return iterator to the first pair.
+     */
+    inline const_iterator begin() const
+    { return const_iterator(*this, 0); }
+
+    /**
+     * @return iterator to after the last pair.
+     */
+    inline const_iterator end() const
+    { return const_iterator(*this, _size); }
+
+    /**
+     * Search a key.
+     * @param key string.
+     * @return iterator to the pair with the given key, or end() if there is no such pair.
+     */
+    inline const_iterator find(const std::string_view &key) const
+    { return find(key, Hash{}(key)); }
+
+    /**
+     * Search with a hash value computed by the caller, like HashMap::find(key, hash).
+     * @param key string.
+     * @param hash the hash value of key - must be equal to what Hash returns for it.
+     * @return iterator to the pair with the given key, or end() if there is no such pair.
+     */
+    const_iterator find(const std::string_view &key, const std::size_t &hash) const
+    {
+        const std::uint64_t found = _find(key, hash);
+#ifdef HASHMAP_STATS
+        _stats.search(found != _size);
+#endif
+        return const_iterator(*this, found);
+    }
+
+    /**
+     * Start loading the slot of the given hash value, like HashMap::prefetch(). The seed that
+     * picks the slot is read here - its array is much smaller than the slots, so it is usually
+     * in the cache.
+     * @param hash the hash value of a key.
+     */
+    inline void prefetch(const std::size_t &hash) const
+    {
+        if (_size != 0)
+        {
+            prefetchRead(_slots + PerfectHash::slot(hash, _seeds, _buckets, _perfectSlots));
+        }
+    }
+
+    /**
+     * @return the lengths of the buckets - every slot of the perfect hash, with the slots after
+     * them of its hash value - and, if compiled with HASHMAP_STATS, the number of searches since
+     * the image was opened.
+     */
+    HashMapStats stats() const
+    {
+        HashMapStats result{(long) _size, (long) _size,
+                            std::vector<long>(STATS_HISTOGRAM_SIZE, 0), 0, false, 0, 0, 0, 0};
+        long shared = 0; // the slots of the perfect hash with keys after them.
+        for (std::uint64_t i = _perfectSlots; i < _size;)
+        {
+            std::uint64_t last = i;
+            while (last + 1 < _size && _slots[last + 1].hash == _slots[i].hash)
+            {
+                ++last;
+            }
+            result.addBuckets((long) (last - i) + 2, 1);
+            ++shared;
+            i = last + 1;
+        }
+        result.addBuckets(1, (long) _perfectSlots - shared);
+#ifdef HASHMAP_STATS
+        _stats.addTo(result);
+#endif
+        return result;
+    }
+
+private:
+    /**
+     * The first bytes of the image.
+     */
+    struct Header
+    {
+        char magic[sizeof(DATABASE_IMAGE_MAGIC)];
+        std::uint32_t version;
+        std::uint32_t slotSize; // sizeof(Slot) of the writer.
+        std::uint64_t hashCheck; // Hash of DATABASE_IMAGE_HASH_CHECK.
+        std::uint64_t size; // the number of pairs.
+        std::uint64_t perfectSlots; // the number of slots of the perfect hash, the first ones.
+        std::uint64_t buckets; // the number of seeds.
+        std::uint64_t lengthCount; // the number of key lengths.
+        std::uint64_t keyBytes; // the number of key bytes.
+    };
+
+    /**
+     * A slot of the table.
+     */
+    struct Slot
+    {
+        std::uint64_t hash; // the hash value of the key.
+        std::uint64_t keyOffset; // the first byte of the key.
+        std::uint32_t keyLength;
+        std::int32_t value;
+    };
+
+    MappedFile _file;
+    const Slot *_slots;
+    const std::uint32_t *_seeds;
+    const std::uint64_t *_lengths;
+    const char *_keys;
+    std::uint64_t _size, _perfectSlots, _buckets, _lengthCount;
+    bool _good;
+#ifdef HASHMAP_STATS
+    StatsCounters _stats; // the searches of this image.
+#endif
+
+    /**
+     * Check the image and set the pointers to its parts. Every part starts at a multiple of 8
+     * bytes from the beginning, and the beginning is page aligned (or aligned by malloc), so the
+     * parts can be read in place.
+     * @param image the bytes of the image.
+     * @return true if the image is valid.
+     */
+    bool _open(const std::string_view &image)
+    {
+        Header header{};
+        if (image.size() < sizeof(header))
+        {
+            return false;
+        }
+        std::memcpy(&header, image.data(), sizeof(header));
+        if (std::memcmp(header.magic, DATABASE_IMAGE_MAGIC, sizeof(header.magic)) != 0 ||
+            header.version != DATABASE_IMAGE_VERSION || header.slotSize != sizeof(Slot) ||
+            header.hashCheck != (std::uint64_t) Hash{}(DATABASE_IMAGE_HASH_CHECK) ||
+            header.buckets == 0 || header.buckets > _padded(header.buckets) ||
+            header.perfectSlots > header.size || (header.perfectSlots == 0) != (header.size == 0))
+        {
+            return false;
+        }
+        std::uint64_t available = image.size() - sizeof(header);
+        if (header.size > available / sizeof(Slot))
+        {
+            return false;
+        }
+        available -= header.size * sizeof(Slot);
+        if (_padded(header.buckets) > available / sizeof(std::uint32_t))
+        {
+            return false;
+        }
+        available -= _padded(header.buckets) * sizeof(std::uint32_t);
+        if (header.lengthCount > available / 8 ||
+            header.keyBytes != available - header.lengthCount * 8)
+        {
+            return false;
+        }
+        _slots = reinterpret_cast<const Slot *>(image.data() + sizeof(header));
+        _seeds = reinterpret_cast<const std::uint32_t *>(_slots + header.size);
+        _lengths = reinterpret_cast<const std::uint64_t *>(_seeds + _padded(header.buckets));
+        _keys = reinterpret_cast<const char *>(_lengths + header.lengthCount);
+        for (std::uint64_t i = 0; i < header.size; ++i)
+        {
+            const Slot &slot = _slots[i];
+            if (slot.keyOffset > header.keyBytes ||
+                slot.keyLength > header.keyBytes - slot.keyOffset)
+            {
+                return false;
+            }
+        }
+        for (std::uint64_t i = 0; i < header.buckets; ++i)
+        {
+            // a direct seed is a slot - the others give a slot in range by themselves.
+            if ((_seeds[i] & PerfectHash::DIRECT_SEED) &&
+                (_seeds[i] & ~PerfectHash::DIRECT_SEED) >= header.perfectSlots)
+            {
+                return false;
+            }
+        }
+        _size = header.size;
+        _perfectSlots = header.perfectSlots;
+        _buckets = header.buckets;
+        _lengthCount = header.lengthCount;
+        return true;
+    }
+
+    /**
+     * Search a key.
+     * @param key string.
+     * @param hash the hash value of key.
+     * @return the slot of the key, or the size of the image if the key is not in it.
+     */
+    std::uint64_t _find(const std::string_view &key, const std::size_t &hash) const
+    {
+        if (_size == 0)
+        {
+            return _size;
+        }
+        const std::uint64_t index = PerfectHash::slot(hash, _seeds, _buckets, _perfectSlots);
+        const Slot &current = _slots[index];
+        if (current.hash != (std::uint64_t) hash)
+        {
+            return _size;
+        }
+        if (KeyEqual{}(_keyAt(current), key))
+        {
+            return index;
+        }
+        // another key of the same hash value has the slot - the key may be after the slots.
+        const Slot *other = std::lower_bound(_slots + _perfectSlots, _slots + _size,
+                                             (std::uint64_t) hash,
+                                             [](const Slot &slot, const std::uint64_t &value)
+                                             { return slot.hash < value; });
+        for (; other != _slots + _size && other->hash == (std::uint64_t) hash; ++other)
+        {
+            if (KeyEqual{}(_keyAt(*other), key))
+            {
+                return (std::uint64_t) (other - _slots);
+            }
+        }
+        return _size;
+    }
+
+    /**
+     * @param slot an occupied slot.
+     * @return the key of the slot.
+     */
+    inline std::string_view _keyAt(const Slot &slot) const
+    { return std::string_view(_keys + slot.keyOffset, slot.keyLength); }
+
+    /**
+     * @param slot an occupied slot.
+     * @return the pair of the slot.
+     */
+    inline value_type _pairAt(const std::uint64_t &slot) const
+    { return value_type(_keyAt(_slots[slot]), _slots[slot].value); }
+
+    /**
+     * @param count a number of seeds.
+     * @return the number of seeds with the padding after them, to a multiple of 8 bytes.
+     */
+    inline static std::uint64_t _padded(const std::uint64_t &count)
+    { return (count + 1) & ~(std::uint64_t) 1; }
+};
+
+#endif //DATABASE_IMAGE_HPP
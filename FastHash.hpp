@@ -0,0 +1,257 @@
+/**
+ * @file FastHash.hpp
+ * @author Aviad Dudkevich
+ * @brief Fast hash function objects for HashMap - a wyhash style hash for strings, a mixing
+ * finalizer for integers, and a rolling hash for probing with every window of a text.
+ */
+#ifndef FAST_HASH_HPP
+#define FAST_HASH_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+/**
+ * HashFunctions class - the building blocks of FastHash. Strings are read 8 bytes at a time,
+ * and every two words are folded into the state by a 64x64->128 bit multiplication (the xor of
+ * its two halves), like wyhash does.
+ */
+class HashFunctions
+{
+public:
+    /**
+     * @param data pointer to the first byte.
+     * @param length the number of bytes.
+     * @param seed another seed gives an unrelated hash function.
+     * @return the hash value of the bytes.
+     */
+    static std::uint64_t bytes(const void *data, const std::size_t &length,
+                               std::uint64_t seed = 0)
+    {
+        const unsigned char *p = static_cast<const unsigned char *>(data);
+        seed ^= _mix(seed ^ SECRET[0], SECRET[1]);
+        std::uint64_t a, b;
+        if (length <= 16)
+        {
+            if (length >= 4)
+            {
+                const std::size_t middle = (length >> 3) << 2; // 0 or 4.
+                a = (_read4(p) << 32) | _read4(p + middle);
+                b = (_read4(p + length - 4) << 32) | _read4(p + length - 4 - middle);
+            }
+            else if (length > 0)
+            {
+                a = ((std::uint64_t) p[0] << 16) | ((std::uint64_t) p[length >> 1] << 8) |
+                    p[length - 1];
+                b = 0;
+            }
+            else
+            {
+                a = b = 0;
+            }
+        }
+        else
+        {
+            std::size_t left = length;
+            if (left > 48) // three independent lanes, so the multiplications can overlap.
+            {
+                std::uint64_t lane1 = seed, lane2 = seed;
+                do
+                {
+                    seed = _mix(_read8(p) ^ SECRET[1], _read8(p + 8) ^ seed);
+                    lane1 = _mix(_read8(p + 16) ^ SECRET[2], _read8(p + 24) ^ lane1);
+                    lane2 = _mix(_read8(p + 32) ^ SECRET[3], _read8(p + 40) ^ lane2);
+                    p += 48;
+                    left -= 48;
+                } while (left > 48);
+                seed ^= lane1 ^ lane2;
+            }
+            while (left > 16)
+            {
+                seed = _mix(_read8(p) ^ SECRET[1], _read8(p + 8) ^ seed);
+                p += 16;
+                left -= 16;
+            }
+            a = _read8(p + left - 16);
+            b = _read8(p + left - 8);
+        }
+        return _mix(SECRET[1] ^ length, _mix(a ^ SECRET[1], b ^ seed));
+    }
+
+    /**
+     * Finalizer of a 64 bit value (the one of MurmurHash3) - every input bit changes about half
+     * of the output bits, so the low bits are good for a power of 2 table even for keys like
+     * multiples of the capacity.
+     * @param value 64 bit value.
+     * @return the mixed value.
+     */
+    inline static std::uint64_t integer(std::uint64_t value)
+    {
+        value ^= value >> 33;
+        value *= 0xFF51AFD7ED558CCDULL;
+        value ^= value >> 33;
+        value *= 0xC4CEB9FE1A85EC53ULL;
+        value ^= value >> 33;
+        return value;
+    }
+
+private:
+    static constexpr std::uint64_t SECRET[4] = {0xA0761D6478BD642FULL, 0xE7037ED1A0B428DBULL,
+                                                0x8EBC6AF09C88C6E3ULL, 0x589965CC75374CC3ULL};
+
+    /**
+     * @return the xor of the low and high halves of the 128 bit product of a and b.
+     */
+    inline static std::uint64_t _mix(const std::uint64_t &a, const std::uint64_t &b)
+    {
+#ifdef __SIZEOF_INT128__
+        const unsigned __int128 product = (unsigned __int128) a * b;
+        return (std::uint64_t) product ^ (std::uint64_t) (product >> 64);
+#else
+        const std::uint64_t aLow = a & 0xFFFFFFFFULL, aHigh = a >> 32;
+        const std::uint64_t bLow = b & 0xFFFFFFFFULL, bHigh = b >> 32;
+        const std::uint64_t lowLow = aLow * bLow, lowHigh = aLow * bHigh;
+        const std::uint64_t highLow = aHigh * bLow, highHigh = aHigh * bHigh;
+        const std::uint64_t middle = (lowLow >> 32) + (lowHigh & 0xFFFFFFFFULL) + highLow;
+        const std::uint64_t low = (middle << 32) | (lowLow & 0xFFFFFFFFULL);
+        const std::uint64_t high = highHigh + (lowHigh >> 32) + (middle >> 32);
+        return low ^ high;
+#endif
+    }
+
+    /**
+     * @param p pointer to 8 bytes, not necessarily aligned.
+     * @return the bytes as a 64 bit value.
+     */
+    inline static std::uint64_t _read8(const unsigned char *p)
+    {
+        std::uint64_t value;
+        std::memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    /**
+     * @param p pointer to 4 bytes, not necessarily aligned.
+     * @return the bytes as a 64 bit value.
+     */
+    inline static std::uint64_t _read4(const unsigned char *p)
+    {
+        std::uint32_t value;
+        std::memcpy(&value, p, sizeof(value));
+        return value;
+    }
+};
+
+/**
+ * Fast hash function object for HashMap. Integer keys go through HashFunctions::integer(), and
+ * other types use std::hash.
+ * @tparam KeyT type argument for generic key.
+ */
+template<typename KeyT, typename = void>
+struct FastHash : std::hash<KeyT>
+{
+};
+
+template<typename KeyT>
+struct FastHash<KeyT, std::enable_if_t<std::is_integral<KeyT>::value>>
+{
+    inline std::size_t operator()(const KeyT &key) const noexcept
+    { return (std::size_t) HashFunctions::integer((std::uint64_t) key); }
+};
+
+/**
+ * Fast hash function object for std::string keys - HashFunctions::bytes() of the characters.
+ * It is transparent, so it hashes any type convertible to std::string_view the same way.
+ */
+template<>
+struct FastHash<std::string>
+{
+    typedef void is_transparent;
+
+    inline std::size_t operator()(const std::string_view &key) const noexcept
+    { return (std::size_t) HashFunctions::bytes(key.data(), key.size()); }
+};
+
+/**
+ * Rolling hash function object for strings - a polynomial of the bytes (Rabin-Karp, modulo
+ * 2^64) that goes through HashFunctions::integer(). The polynomial of a window of a text can be
+ * moved one byte forward in constant time with roll(), so a map of strings with this hash can
+ * be probed by every window of a text without hashing each window from the beginning.
+ * It is transparent, so it hashes any type convertible to std::string_view the same way.
+ */
+struct RollingHash
+{
+    typedef void is_transparent;
+
+    /**
+     * @param key string.
+     * @return the hash value of the string - finish() of its polynomial.
+     */
+    inline std::size_t operator()(const std::string_view &key) const noexcept
+    { return finish(polynomial(key.data(), key.size())); }
+
+    /**
+     * @param data pointer to the first byte.
+     * @param length the number of bytes.
+     * @return the polynomial of the bytes.
+     */
+    static std::uint64_t polynomial(const char *data, const std::size_t &length)
+    {
+        std::uint64_t result = 0;
+        for (std::size_t i = 0; i < length; ++i)
+        {
+            result = append(result, data[i]);
+        }
+        return result;
+    }
+
+    /**
+     * @param polynomial the polynomial of a string.
+     * @param in a byte.
+     * @return the polynomial of the string followed by the byte.
+     */
+    inline static std::uint64_t append(const std::uint64_t &polynomial, const char &in)
+    { return polynomial * BASE + (unsigned char) in; }
+
+    /**
+     * @param length window length, at least 1.
+     * @return the weight of the first byte of a window of that length, for roll().
+     */
+    static std::uint64_t firstWeight(const std::size_t &length)
+    {
+        std::uint64_t result = 1;
+        for (std::size_t i = 1; i < length; ++i)
+        {
+            result *= BASE;
+        }
+        return result;
+    }
+
+    /**
+     * Move a window one byte forward.
+     * @param polynomial the polynomial of the window.
+     * @param out the first byte of the window.
+     * @param in the byte after the window.
+     * @param weight firstWeight() of the window length.
+     * @return the polynomial of the next window.
+     */
+    inline static std::uint64_t roll(const std::uint64_t &polynomial, const char &out,
+                                     const char &in, const std::uint64_t &weight)
+    { return (polynomial - (unsigned char) out * weight) * BASE + (unsigned char) in; }
+
+    /**
+     * @param polynomial the polynomial of a string.
+     * @return the hash value of the string.
+     */
+    inline static std::size_t finish(const std::uint64_t &polynomial)
+    { return (std::size_t) HashFunctions::integer(polynomial); }
+
+private:
+    static constexpr std::uint64_t BASE = 0x100000001B3ULL; // odd, so no byte is ever lost.
+};
+
+#endif //FAST_HASH_HPP
@@ -0,0 +1,806 @@
+/**
+ * @file FlatTable.hpp
+ * @author Aviad Dudkevich
+ * @brief Open addressing storage engine for HashMap - one contiguous array of slots with a
+ * control byte per slot (SwissTable style), probed a group of slots at a time.
+ */
+#ifndef FLAT_TABLE_HPP
+#define FLAT_TABLE_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <new>
+#include <utility>
+#include "HashedEntry.hpp"
+#include "Prefetch.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FLAT_TABLE_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define FLAT_TABLE_NEON
+#include <arm_neon.h>
+#endif
+
+/**
+ * ControlGroup class - GROUP_WIDTH consecutive control bytes of a FlatTable, compared all at once
+ * with SSE2 or NEON instructions when available, and byte by byte otherwise. Every match returns
+ * a bit mask, where bit i is on if the i-th control byte of the group matched.
+ */
+class ControlGroup
+{
+public:
+    typedef signed char ctrl_t;
+
+    static const int GROUP_WIDTH = 16;
+
+    // Control bytes. A full slot holds its 7 bits tag, so it is never negative.
+    static const ctrl_t EMPTY = -128;
+    static const ctrl_t DELETED = -2;
+
+    /**
+     * Constructor - load the group.
+     * @param ctrl pointer to the first control byte of the group, may be unaligned.
+     */
+    explicit ControlGroup(const ctrl_t *ctrl)
+    {
+#if defined(FLAT_TABLE_SSE2)
+        _ctrl = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ctrl));
+#elif defined(FLAT_TABLE_NEON)
+        _ctrl = vld1q_s8(ctrl);
+#else
+        std::memcpy(_ctrl, ctrl, GROUP_WIDTH);
+#endif
+    }
+
+    /**
+     * @param tag the tag of full slot.
+     * @return bit mask of the slots with that tag.
+     */
+    inline std::uint32_t match(ctrl_t tag) const
+    {
+#if defined(FLAT_TABLE_SSE2)
+        return (std::uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(_ctrl, _mm_set1_epi8(tag)));
+#elif defined(FLAT_TABLE_NEON)
+        return _toMask(vceqq_s8(_ctrl, vdupq_n_s8(tag)));
+#else
+        std::uint32_t mask = 0;
+        for (int i = 0; i < GROUP_WIDTH; ++i)
+        {
+            mask |= (std::uint32_t) (_ctrl[i] == tag) << i;
+        }
+        return mask;
+#endif
+    }
+
+    /**
+     * @return bit mask of the empty slots.
+     */
+    inline std::uint32_t matchEmpty() const
+    { return match(EMPTY); }
+
+    /**
+     * @return bit mask of the empty or deleted slots.
+     */
+    inline std::uint32_t matchEmptyOrDeleted() const
+    {
+#if defined(FLAT_TABLE_SSE2)
+        return (std::uint32_t) _mm_movemask_epi8(_ctrl); // the sign bit of every byte.
+#elif defined(FLAT_TABLE_NEON)
+        return _toMask(vcltq_s8(_ctrl, vdupq_n_s8(0)));
+#else
+        std::uint32_t mask = 0;
+        for (int i = 0; i < GROUP_WIDTH; ++i)
+        {
+            mask |= (std::uint32_t) (_ctrl[i] < 0) << i;
+        }
+        return mask;
+#endif
+    }
+
+    /**
+     * @return bit mask of the full slots.
+     */
+    inline std::uint32_t matchFull() const
+    { return ~matchEmptyOrDeleted() & ((1u << GROUP_WIDTH) - 1); }
+
+    /**
+     * @param mask non zero bit mask.
+     * @return the index of the lowest bit that is on.
+     */
+    inline static int lowestBit(const std::uint32_t &mask)
+    {
+#if defined(__GNUC__)
+        return __builtin_ctz(mask);
+#else
+        int i = 0;
+        while (!(mask & (1u << i)))
+        {
+            ++i;
+        }
+        return i;
+#endif
+    }
+
+    /**
+     * @param mask bit mask of a group.
+     * @return the number of bits that are off in a row from the highest bit of the group.
+     */
+    inline static int leadingZeros(const std::uint32_t &mask)
+    {
+        int i = 0;
+        while (i < GROUP_WIDTH && !(mask & (1u << (GROUP_WIDTH - 1 - i))))
+        {
+            ++i;
+        }
+        return i;
+    }
+
+private:
+#if defined(FLAT_TABLE_SSE2)
+    __m128i _ctrl;
+#elif defined(FLAT_TABLE_NEON)
+    int8x16_t _ctrl;
+
+    /**
+     * @param compared result of NEON compare - every byte is all ones or all zeros.
+     * @return bit mask with a bit for every byte.
+     */
+    inline static std::uint32_t _toMask(const uint8x16_t &compared)
+    {
+        static const uint8_t BITS[GROUP_WIDTH] = {1, 2, 4, 8, 16, 32, 64, 128,
+                                                  1, 2, 4, 8, 16, 32, 64, 128};
+        const uint8x16_t bits = vandq_u8(compared, vld1q_u8(BITS));
+        return (std::uint32_t) vaddv_u8(vget_low_u8(bits)) |
+               ((std::uint32_t) vaddv_u8(vget_high_u8(bits)) << 8);
+    }
+#else
+    ctrl_t _ctrl[GROUP_WIDTH];
+#endif
+};
+
+/**
+ * FlatTable class - hash table storage with all the pairs in a single array of slots. Every slot
+ * has a control byte: empty, deleted, or the low 7 bits of the hash of the pair in it (the tag).
+ * Lookups load a ControlGroup of 16 control bytes and compare all their tags at once, so keys
+ * are compared with == almost only on real matches. Probing moves between groups in a triangular
+ * sequence, which visits every group of a power of 2 table. There are GROUP_WIDTH extra control
+ * bytes after the last slot that clone the first ones, so a group can start at any slot.
+ * Erase leaves a tombstone unless no probe sequence could have passed through the slot.
+ * The table never changes its own capacity unless asked to by rehash() or when tombstones fill
+ * it - keeping the load factor is the HashMap responsibility.
+ * @tparam KeyT type argument for generic key.
+ * @tparam ValueT type argument for generic value.
+ * @tparam Hash hash function object for KeyT.
+ * @tparam KeyEqual function object that compares two keys.
+ * @tparam Allocator allocator of pairs - the slots and the control bytes are allocated by it.
+ * @tparam CacheHash true to keep the hash value of every key next to its pair.
+ */
+template<typename KeyT, typename ValueT, typename Hash, typename KeyEqual, typename Allocator,
+        bool CacheHash>
+class FlatTable
+{
+    typedef ControlGroup::ctrl_t ctrl_t;
+
+public:
+    typedef std::pair<KeyT, ValueT> value_type;
+    typedef Allocator allocator_type;
+    typedef long Position;
+
+    /**
+     * Constructor given the number of slots.
+     * @param capacity long, must be a power of 2.
+     * @param allocator the allocator of the table.
+     */
+    explicit FlatTable(const long &capacity, const Allocator &allocator = Allocator()) :
+            _allocator(allocator), _capacity(capacity), _size(0), _deleted(0), _ctrl(nullptr),
+            _slots(nullptr)
+    {
+        _allocate(_capacity, _ctrl, _slots);
+    }
+
+    /**
+     * Copy constructor - copy slot by slot, so the layout is the same as the other table.
+     * @param other another FlatTable.
+     */
+    FlatTable(const FlatTable &other) :
+            _allocator(std::allocator_traits<EntryAllocator>::
+                       select_on_container_copy_construction(other._allocator)),
+            _capacity(other._capacity), _size(0), _deleted(other._deleted), _ctrl(nullptr),
+            _slots(nullptr)
+    {
+        _allocate(_capacity, _ctrl, _slots);
+        std::memcpy(_ctrl, other._ctrl, _ctrlBytes(_capacity));
+        try
+        {
+            for (long i = _nextFull(_ctrl, _capacity, 0); i < _capacity;
+                 i = _nextFull(_ctrl, _capacity, i + 1))
+            {
+                ::new(static_cast<void *>(_slots + i)) Entry(other._slots[i]);
+                ++_size;
+            }
+        }
+        catch (...)
+        {
+            _destroyUntil(_size);
+            _deallocate(_capacity, _ctrl, _slots);
+            throw;
+        }
+    }
+
+    /**
+     * Move constructor. The other table is left without slots.
+     * @param other rvalue reference to FlatTable.
+     */
+    FlatTable(FlatTable &&other) noexcept : _allocator(other._allocator),
+                                            _capacity(other._capacity), _size(other._size),
+                                            _deleted(other._deleted), _ctrl(other._ctrl),
+                                            _slots(other._slots)
+    {
+        other._capacity = 0;
+        other._size = 0;
+        other._deleted = 0;
+        other._ctrl = nullptr;
+        other._slots = nullptr;
+    }
+
+    /**
+     * Destructor.
+     */
+    ~FlatTable()
+    {
+        _destroyUntil(_size);
+        _deallocate(_capacity, _ctrl, _slots);
+    }
+
+    FlatTable &operator=(const FlatTable &other) = delete;
+
+    /**
+     * @return the number of slots.
+     */
+    inline long capacity() const
+    { return _capacity; }
+
+    /**
+     * @return the allocator of the table.
+     */
+    inline Allocator get_allocator() const
+    { return Allocator(_allocator); }
+
+    /**
+     * @return the number of pairs in the table.
+     */
+    inline long size() const
+    { return _size; }
+
+    /**
+     * @param key KeyT value, or a key-like value if Hash is transparent.
+     * @return the hash value of the key.
+     */
+    template<typename K>
+    inline static std::size_t hashOf(const K &key)
+    { return Hash{}(key); }
+
+    /**
+     * Search for the pair with the given key.
+     * @param key KeyT value, or a key-like value comparable to KeyT with KeyEqual.
+     * @param hash the hash value of key.
+     * @return position of the pair, or end() if there is no pair with that key.
+     */
+    template<typename K>
+    Position find(const K &key, const std::size_t &hash) const
+    {
+        const std::size_t mixed = _mix(hash);
+        const ctrl_t tag = _tag(mixed);
+        const long mask = _capacity - 1;
+        long offset = _home(mixed, _capacity);
+        for (long step = ControlGroup::GROUP_WIDTH; ; step += ControlGroup::GROUP_WIDTH)
+        {
+            const ControlGroup group(_ctrl + offset);
+            for (std::uint32_t match = group.match(tag); match != 0; match &= match - 1)
+            {
+                const long i = (offset + ControlGroup::lowestBit(match)) & mask;
+                if (_slots[i].hashMatches(hash) && KeyEqual{}(_slots[i].value.first, key))
+                {
+                    return i;
+                }
+            }
+            if (group.matchEmpty() != 0 || step >= _capacity) // the key can't be further.
+            {
+                return end();
+            }
+            offset = (offset + step) & mask;
+        }
+    }
+
+    /**
+     * Start loading the control bytes and the slot at the home of the given hash value - all a
+     * lookup reads on a short probe sequence.
+     * @param hash hash value of a key.
+     */
+    inline void prefetch(const std::size_t &hash) const
+    {
+        const long home = _home(_mix(hash), _capacity);
+        prefetchRead(_ctrl + home);
+        prefetchRead(_slots + home);
+    }
+
+    /**
+     * Search for the pair with the given key, and if it is missing - where to add it.
+     * @param key KeyT value, or a key-like value comparable to KeyT with KeyEqual.
+     * @param hash the hash value of key.
+     * @return the position of the pair and true, or the first free slot on the probe sequence
+     * (end() if there is none) and false if there is no pair with that key.
+     */
+    template<typename K>
+    std::pair<Position, bool> findOrPrepareInsert(const K &key, const std::size_t &hash) const
+    {
+        const std::size_t mixed = _mix(hash);
+        const ctrl_t tag = _tag(mixed);
+        const long mask = _capacity - 1;
+        long offset = _home(mixed, _capacity);
+        Position freeSlot = end();
+        for (long step = ControlGroup::GROUP_WIDTH; ; step += ControlGroup::GROUP_WIDTH)
+        {
+            const ControlGroup group(_ctrl + offset);
+            for (std::uint32_t match = group.match(tag); match != 0; match &= match - 1)
+            {
+                const long i = (offset + ControlGroup::lowestBit(match)) & mask;
+                if (_slots[i].hashMatches(hash) && KeyEqual{}(_slots[i].value.first, key))
+                {
+                    return {i, true};
+                }
+            }
+            const std::uint32_t free = group.matchEmptyOrDeleted();
+            if (freeSlot == end() && free != 0)
+            {
+                freeSlot = (offset + ControlGroup::lowestBit(free)) & mask;
+            }
+            if (group.matchEmpty() != 0 || step >= _capacity)
+            {
+                return {freeSlot, false};
+            }
+            offset = (offset + step) & mask;
+        }
+    }
+
+    /**
+     * Construct a new pair in the table. Assumption: there is no pair with the same key, and
+     * the table has a free slot.
+     * @param hash the hash value of the key of the new pair.
+     * @param args arguments for the pair constructor.
+     * @return position of the new pair.
+     */
+    template<typename... Args>
+    inline Position emplace(const std::size_t &hash, Args &&... args)
+    { return emplaceAt(end(), hash, std::forward<Args>(args)...); }
+
+    /**
+     * Construct a new pair in the position returned by findOrPrepareInsert(), without probing
+     * again. Assumption: the table didn't change since then, and it has a free slot.
+     * @param position position returned by findOrPrepareInsert(), or end() to probe for one.
+     * @param hash the hash value of the key of the new pair.
+     * @param args arguments for the pair constructor.
+     * @return position of the new pair.
+     */
+    template<typename... Args>
+    Position emplaceAt(const Position &position, const std::size_t &hash, Args &&... args)
+    {
+        const std::size_t mixed = _mix(hash);
+        long slot = position;
+        if (_deleted > 0 && _size + _deleted >= _capacity - _capacity / TOMBSTONES_FACTOR)
+        {
+            rehash(_capacity); // too many tombstones - lookups would scan long chains.
+            slot = end();
+        }
+        if (slot == end())
+        {
+            slot = _findFreeSlot(_ctrl, _capacity, mixed);
+        }
+        ::new(static_cast<void *>(_slots + slot)) Entry(hash, std::forward<Args>(args)...);
+        if (_ctrl[slot] == ControlGroup::DELETED)
+        {
+            --_deleted;
+        }
+        _setCtrl(_ctrl, _capacity, slot, _tag(mixed));
+        ++_size;
+        return slot;
+    }
+
+    /**
+     * Remove the pair in the given position. The other pairs stay in their slots.
+     * @param position position of existing pair.
+     * @return position of the pair after it in iteration order, or end() if it was the last one.
+     */
+    Position erase(const Position &position)
+    {
+        _slots[position].~Entry();
+        if (_wasNeverFull(position))
+        {
+            _setCtrl(_ctrl, _capacity, position, ControlGroup::EMPTY);
+        }
+        else
+        {
+            _setCtrl(_ctrl, _capacity, position, ControlGroup::DELETED);
+            ++_deleted;
+        }
+        --_size;
+        return next(position);
+    }
+
+    /**
+     * @param position position of existing pair.
+     * @return reference to the pair.
+     */
+    inline value_type &get(const Position &position)
+    { return _slots[position].value; }
+
+    /**
+     * @param position position of existing pair.
+     * @return const reference to the pair.
+     */
+    inline const value_type &get(const Position &position) const
+    { return _slots[position].value; }
+
+    /**
+     * @param position position of existing pair.
+     * @return the hash value of the key of the pair.
+     */
+    inline std::size_t hashAt(const Position &position) const
+    { return _slots[position].hash(Hash{}); }
+
+    /**
+     * @return position of the first pair, or end() if the table is empty.
+     */
+    inline Position begin() const
+    { return _getNextFullSlot(0); }
+
+    /**
+     * @param position position of existing pair.
+     * @return position of the pair after it, or end() if it is the last one.
+     */
+    inline Position next(const Position &position) const
+    { return _getNextFullSlot(position + 1); }
+
+    /**
+     * @return position after the last pair.
+     */
+    inline Position end() const
+    { return _capacity; }
+
+    /**
+     * @param hash hash value of a key.
+     * @return the number of pairs with the same home slot as that hash.
+     */
+    long bucketSize(const std::size_t &hash) const
+    {
+        const long mask = _capacity - 1;
+        const long home = _home(_mix(hash), _capacity);
+        if (_capacity <= ControlGroup::GROUP_WIDTH) // one group holds all the table.
+        {
+            return _countHome(0, _capacity, home);
+        }
+        long result = 0, offset = home;
+        for (long step = ControlGroup::GROUP_WIDTH; ; step += ControlGroup::GROUP_WIDTH)
+        {
+            result += _countHome(offset, ControlGroup::GROUP_WIDTH, home);
+            if (ControlGroup(_ctrl + offset).matchEmpty() != 0 || step >= _capacity)
+            {
+                return result;
+            }
+            offset = (offset + step) & mask;
+        }
+    }
+
+    /**
+     * Erase all pairs, keep the capacity.
+     */
+    void clear()
+    {
+        _destroyUntil(_size);
+        std::memset(_ctrl, ControlGroup::EMPTY, _ctrlBytes(_capacity));
+        _size = 0;
+        _deleted = 0;
+    }
+
+    /**
+     * Move all pairs to a new table with the given capacity. Also drops all the tombstones.
+     * The pairs are copied instead only if their move constructor may throw, so a failed rehash
+     * leaves the table as it was.
+     * @param newCapacity the capacity of the new table, must be a power of 2 and not smaller
+     * than size().
+     */
+    void rehash(const long &newCapacity)
+    {
+        ctrl_t *newCtrl;
+        Entry *newSlots;
+        _allocate(newCapacity, newCtrl, newSlots);
+        long moved = 0;
+        try
+        {
+            for (long i = _getNextFullSlot(0); i < _capacity; i = _getNextFullSlot(i + 1))
+            {
+                const std::size_t hash = _slots[i].hash(Hash{});
+                const std::size_t mixed = _mix(hash);
+                const long slot = _findFreeSlot(newCtrl, newCapacity, mixed);
+                ::new(static_cast<void *>(newSlots + slot)) Entry(std::move_if_noexcept(_slots[i]));
+                _setCtrl(newCtrl, newCapacity, slot, _tag(mixed));
+                ++moved;
+            }
+        }
+        catch (...)
+        {
+            for (long i = _nextFull(newCtrl, newCapacity, 0); i < newCapacity && moved > 0;
+                 i = _nextFull(newCtrl, newCapacity, i + 1))
+            {
+                newSlots[i].~Entry();
+                --moved;
+            }
+            _deallocate(newCapacity, newCtrl, newSlots);
+            throw;
+        }
+        _destroyUntil(_size);
+        _deallocate(_capacity, _ctrl, _slots);
+        _ctrl = newCtrl;
+        _slots = newSlots;
+        _capacity = newCapacity;
+        _deleted = 0;
+    }
+
+    /**
+     * Aid swap of HashMap.
+     * @param first FlatTable reference.
+     * @param second FlatTable reference.
+     */
+    friend void swap(FlatTable &first, FlatTable &second) noexcept
+    {
+        using std::swap;
+        swap(first._allocator, second._allocator);
+        swap(first._capacity, second._capacity);
+        swap(first._size, second._size);
+        swap(first._deleted, second._deleted);
+        swap(first._ctrl, second._ctrl);
+        swap(first._slots, second._slots);
+    }
+
+private:
+    typedef HashedEntry<value_type, CacheHash> Entry;
+    typedef typename std::allocator_traits<Allocator>::template rebind_alloc<Entry> EntryAllocator;
+    typedef typename std::allocator_traits<Allocator>::template rebind_alloc<ctrl_t>
+            CtrlAllocator;
+
+    // rebuild the table when less than 1/TOMBSTONES_FACTOR of the slots are empty.
+    static const long TOMBSTONES_FACTOR = 8;
+
+    EntryAllocator _allocator; // allocates the slots, and its copies allocate the control bytes.
+    long _capacity, _size, _deleted; // deleted - how many tombstones in the table.
+    ctrl_t *_ctrl; // control byte for every slot, and GROUP_WIDTH clones of the first ones.
+    Entry *_slots; // uninitialized storage for the pairs, constructed only in full slots.
+
+    /**
+     * Scramble the hash value, so hash functions like the identity for integers still spread
+     * over both the slot index and the tag.
+     * @param hash hash value of a key.
+     * @return mixed hash value.
+     */
+    inline static std::size_t _mix(const std::size_t &hash)
+    {
+        std::size_t mixed = hash * (std::size_t) 0x9E3779B97F4A7C15ULL;
+        return mixed ^ (mixed >> 32);
+    }
+
+    /**
+     * @param mixed mixed hash value.
+     * @return the tag to keep in the control byte.
+     */
+    inline static ctrl_t _tag(const std::size_t &mixed)
+    { return (ctrl_t) (mixed & 0x7F); }
+
+    /**
+     * @param mixed mixed hash value.
+     * @param tableSize long.
+     * @return the first slot to probe.
+     */
+    inline static long _home(const std::size_t &mixed, const long &tableSize)
+    { return (long) ((mixed >> 7) & (tableSize - 1)); }
+
+    /**
+     * @param ctrl control byte.
+     * @return true if the slot holds a pair.
+     */
+    inline static bool _isFull(ctrl_t ctrl)
+    { return ctrl >= 0; }
+
+    /**
+     * @param capacity number of slots.
+     * @return the number of control bytes of a table with that capacity.
+     */
+    inline static std::size_t _ctrlBytes(const long &capacity)
+    { return (std::size_t) capacity + ControlGroup::GROUP_WIDTH; }
+
+    /**
+     * Set a control byte and its clones after the last slot.
+     * @param ctrl control bytes of a table.
+     * @param capacity number of slots of that table.
+     * @param slot the slot to set.
+     * @param value the new control byte.
+     */
+    inline static void _setCtrl(ctrl_t *ctrl, const long &capacity, const long &slot,
+                                ctrl_t value)
+    {
+        for (long i = slot; i < capacity + ControlGroup::GROUP_WIDTH; i += capacity)
+        {
+            ctrl[i] = value;
+        }
+    }
+
+    /**
+     * Assumption: the table has a free slot.
+     * @param ctrl control bytes of a table.
+     * @param capacity number of slots of that table.
+     * @param mixed mixed hash value of a new key.
+     * @return the first empty or deleted slot on the probe sequence of that key.
+     */
+    static long _findFreeSlot(const ctrl_t *ctrl, const long &capacity, const std::size_t &mixed)
+    {
+        const long mask = capacity - 1;
+        long offset = _home(mixed, capacity);
+        for (long step = ControlGroup::GROUP_WIDTH; ; step += ControlGroup::GROUP_WIDTH)
+        {
+            const std::uint32_t free = ControlGroup(ctrl + offset).matchEmptyOrDeleted();
+            if (free != 0)
+            {
+                return (offset + ControlGroup::lowestBit(free)) & mask;
+            }
+            offset = (offset + step) & mask;
+        }
+    }
+
+    /**
+     * A slot can be emptied if every group that holds it has an empty slot on both its sides
+     * close enough - in that case no probe sequence continued after a full group through it.
+     * @param slot full slot.
+     * @return true if the slot can be marked as empty instead of deleted.
+     */
+    bool _wasNeverFull(const long &slot) const
+    {
+        if (_capacity <= ControlGroup::GROUP_WIDTH)
+        {
+            return true; // one group holds all the table, so there is no probing after it.
+        }
+        const long before = (slot - ControlGroup::GROUP_WIDTH) & (_capacity - 1);
+        const std::uint32_t emptyAfter = ControlGroup(_ctrl + slot).matchEmpty();
+        const std::uint32_t emptyBefore = ControlGroup(_ctrl + before).matchEmpty();
+        return emptyAfter != 0 && emptyBefore != 0 &&
+               ControlGroup::lowestBit(emptyAfter) + ControlGroup::leadingZeros(emptyBefore) <
+               ControlGroup::GROUP_WIDTH;
+    }
+
+    /**
+     * @param offset the first slot to check.
+     * @param count the number of slots to check.
+     * @param home a home slot.
+     * @return the number of full slots in the range whose pair has that home slot.
+     */
+    long _countHome(const long &offset, const long &count, const long &home) const
+    {
+        long result = 0;
+        for (long j = 0; j < count; ++j)
+        {
+            const long i = (offset + j) & (_capacity - 1);
+            if (_isFull(_ctrl[i]) && _home(_mix(_slots[i].hash(Hash{})), _capacity) == home)
+            {
+                ++result;
+            }
+        }
+        return result;
+    }
+
+    /**
+     * Find the next full slot a group at a time, so the walk over a sparse table - after many
+     * erases - skips GROUP_WIDTH empty slots per step. The clones after the last slot may report
+     * full slots beyond the table, so the result is capped by the capacity.
+     * @param ctrl control bytes of a table.
+     * @param capacity number of slots of that table.
+     * @param slot the slot to start from.
+     * @return the first full slot from the given slot, or the capacity if there is none.
+     */
+    static long _nextFull(const ctrl_t *ctrl, const long &capacity, long slot)
+    {
+        for (; slot < capacity; slot += ControlGroup::GROUP_WIDTH)
+        {
+            const std::uint32_t full = ControlGroup(ctrl + slot).matchFull();
+            if (full != 0)
+            {
+                return std::min(slot + ControlGroup::lowestBit(full), capacity);
+            }
+        }
+        return capacity;
+    }
+
+    /**
+     * @param slot the slot to start from.
+     * @return the first full slot from the given slot, or end().
+     */
+    inline Position _getNextFullSlot(const long &slot) const
+    { return _nextFull(_ctrl, _capacity, slot); }
+
+    /**
+     * Destroy the first count pairs of the table.
+     * @param count how many pairs to destroy.
+     */
+    void _destroyUntil(long count)
+    {
+        for (long i = _getNextFullSlot(0); i < _capacity && count > 0; i = _getNextFullSlot(i + 1))
+        {
+            _slots[i].~Entry();
+            --count;
+        }
+    }
+
+    /**
+     * Allocate control bytes and slots. All the control bytes are set to EMPTY.
+     * @param capacity number of slots.
+     * @param ctrl output pointer to the control bytes.
+     * @param slots output pointer to the slots.
+     */
+    void _allocate(const long &capacity, ctrl_t *&ctrl, Entry *&slots)
+    {
+        CtrlAllocator ctrlAllocator(_allocator);
+        ctrl = std::allocator_traits<CtrlAllocator>::allocate(ctrlAllocator, _ctrlBytes(capacity));
+        try
+        {
+            slots = std::allocator_traits<EntryAllocator>::allocate(_allocator,
+                                                                    (std::size_t) capacity);
+        }
+        catch (...)
+        {
+            std::allocator_traits<CtrlAllocator>::deallocate(ctrlAllocator, ctrl,
+                                                             _ctrlBytes(capacity));
+            throw;
+        }
+        std::memset(ctrl, ControlGroup::EMPTY, _ctrlBytes(capacity));
+    }
+
+    /**
+     * Free control bytes and slots. Assumption: all the pairs are already destroyed.
+     * @param capacity number of slots.
+     * @param ctrl pointer to the control bytes.
+     * @param slots pointer to the slots.
+     */
+    void _deallocate(const long &capacity, ctrl_t *&ctrl, Entry *&slots)
+    {
+        if (ctrl != nullptr)
+        {
+            CtrlAllocator ctrlAllocator(_allocator);
+            std::allocator_traits<CtrlAllocator>::deallocate(ctrlAllocator, ctrl,
+                                                             _ctrlBytes(capacity));
+        }
+        if (slots != nullptr)
+        {
+            std::allocator_traits<EntryAllocator>::deallocate(_allocator, slots,
+                                                              (std::size_t) capacity);
+        }
+        ctrl = nullptr;
+        slots = nullptr;
+    }
+};
+
+/**
+ * Storage policy for HashMap - open addressing in a single flat array of slots.
+ * @tparam CacheHash true to keep the hash value of every key next to its pair.
+ */
+template<bool CacheHash = false>
+struct BasicFlatStorage
+{
+    template<typename KeyT, typename ValueT, typename Hash, typename KeyEqual, typename Allocator>
+    using Table = FlatTable<KeyT, ValueT, Hash, KeyEqual, Allocator, CacheHash>;
+};
+
+typedef BasicFlatStorage<false> FlatStorage;
+typedef BasicFlatStorage<true> CachedFlatStorage;
+
+#endif //FLAT_TABLE_HPP
@@ -0,0 +1,453 @@
+/**
+ * @file FrozenHashMap.hpp
+ * @author Aviad Dudkevich
+ * @brief Immutable map with a minimal perfect hash - every key has a slot of its own, so a lookup
+ * is a single probe, and there are exactly as many slots as pairs.
+ */
+#ifndef FROZEN_HASHMAP_HPP
+#define FROZEN_HASHMAP_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "HashMap.hpp"
+
+// Constants
+const std::uint64_t PERFECT_HASH_BUCKET_SIZE = 2; // the average number of keys in a bucket.
+const std::uint32_t PERFECT_HASH_MAX_SEED = 1U << 20;
+static const char *EQUAL_HASH_VALUES_ERROR_MSG = "PerfectHash got two equal hash values.\n";
+static const char *EQUAL_KEYS_ERROR_MSG = "FrozenHashMap got two equal keys.\n";
+
+/**
+ * PerfectHash class - builds a minimal perfect hash of a set of distinct 64 bit hash values, in
+ * the style of CHD (compress, hash, displace). The values are split into buckets of a few
+ * values each, and every bucket gets a seed: the slot of a value is a mix of the value and the
+ * seed of its bucket. The buckets are placed biggest first, each with the first seed that sends
+ * all its values to free slots; single value buckets, placed last, keep the slot itself in the
+ * seed, marked by DIRECT_SEED - a table that is nearly full would need many tries for them.
+ * The functions work on plain arrays, so the seeds can be stored in a file and used in place.
+ */
+class PerfectHash
+{
+public:
+    static constexpr std::uint32_t DIRECT_SEED = 1U << 31;
+
+    /**
+     * Build the seeds for a set of hash values. Throws invalid_argument if two of the values are
+     * equal.
+     * This function can throw bad_alloc exception.
+     * @param hashes distinct hash values.
+     * @return the seed of every bucket - slot() sends the i'th value to a slot of its own, in
+     * [0, hashes.size()).
+     */
+    static std::vector<std::uint32_t> build(const std::vector<std::uint64_t> &hashes)
+    {
+        const std::uint64_t size = hashes.size();
+        for (std::uint64_t buckets = size / PERFECT_HASH_BUCKET_SIZE + 1;; buckets *= 2)
+        {
+            std::vector<std::uint32_t> seeds(buckets, 0);
+            if (_place(hashes, seeds))
+            {
+                return seeds;
+            }
+        }
+    }
+
+    /**
+     * @param hash a hash value.
+     * @param seeds the seeds build() returned.
+     * @param buckets the number of seeds.
+     * @param size the number of slots - the number of hash values the seeds were built for.
+     * @return the slot of the hash value. A value the seeds were not built for gets some slot.
+     */
+    inline static std::uint64_t slot(const std::uint64_t &hash, const std::uint32_t *seeds,
+                                     const std::uint64_t &buckets, const std::uint64_t &size)
+    {
+        const std::uint64_t mixed = HashFunctions::integer(hash);
+        const std::uint32_t seed = seeds[mixed % buckets];
+        if (seed & DIRECT_SEED)
+        {
+            return seed & ~DIRECT_SEED;
+        }
+        return _slotOf(mixed, seed, size);
+    }
+
+private:
+    /**
+     * @param mixed the mixed hash value.
+     * @param seed a seed without DIRECT_SEED.
+     * @param size the number of slots.
+     * @return the slot for the value with that seed.
+     */
+    inline static std::uint64_t _slotOf(const std::uint64_t &mixed, const std::uint32_t &seed,
+                                        const std::uint64_t &size)
+    { return HashFunctions::integer(mixed ^ (seed * 0x9E3779B97F4A7C15ULL + seed)) % size; }
+
+    /**
+     * Try to place all the hash values with a given number of buckets.
+     * @param hashes distinct hash values.
+     * @param seeds one seed for every bucket, all 0 - they are set.
+     * @return true if all the values were placed, false if a bucket ran out of seeds.
+     */
+    static bool _place(const std::vector<std::uint64_t> &hashes, std::vector<std::uint32_t> &seeds)
+    {
+        const std::uint64_t size = hashes.size(), buckets = seeds.size();
+        // the mixed values, grouped by bucket - those of bucket i start at starts[i].
+        std::vector<std::uint64_t> starts(buckets + 1, 0), members(size);
+        for (const std::uint64_t &hash: hashes)
+        {
+            ++starts[HashFunctions::integer(hash) % buckets + 1];
+        }
+        for (std::uint64_t i = 0; i < buckets; ++i)
+        {
+            starts[i + 1] += starts[i];
+        }
+        std::vector<std::uint64_t> filled(starts.begin(), starts.end() - 1);
+        for (const std::uint64_t &hash: hashes)
+        {
+            const std::uint64_t mixed = HashFunctions::integer(hash);
+            members[filled[mixed % buckets]++] = mixed;
+        }
+        const auto bucketSize = [&starts](const std::uint64_t &bucket)
+        { return starts[bucket + 1] - starts[bucket]; };
+        std::vector<std::uint64_t> order(buckets);
+        for (std::uint64_t i = 0; i < buckets; ++i)
+        {
+            order[i] = i;
+        }
+        std::stable_sort(order.begin(), order.end(), [&bucketSize](const std::uint64_t &a,
+                                                                  const std::uint64_t &b)
+        { return bucketSize(a) > bucketSize(b); });
+        std::vector<bool> taken(size, false);
+        std::vector<std::uint64_t> slots;
+        std::uint64_t nextFree = 0; // no free slot is before it.
+        for (const std::uint64_t &bucket: order)
+        {
+            const std::uint64_t count = bucketSize(bucket);
+            if (count == 0)
+            {
+                break; // sorted by size, all the rest are empty too.
+            }
+            if (count == 1)
+            {
+                while (taken[nextFree])
+                {
+                    ++nextFree;
+                }
+                taken[nextFree] = true;
+                seeds[bucket] = DIRECT_SEED | (std::uint32_t) nextFree;
+                continue;
+            }
+            std::uint32_t seed = 0;
+            while (!_tryPlace(members.data() + starts[bucket], count, seed, size, taken, slots))
+            {
+                if (++seed == PERFECT_HASH_MAX_SEED)
+                {
+                    return false;
+                }
+            }
+            seeds[bucket] = seed;
+        }
+        return true;
+    }
+
+    /**
+     * Place the values of a bucket with a seed, if all of them get free and distinct slots.
+     * Throws invalid_argument if two of the values are equal.
+     * @param values the mixed hash values of the bucket.
+     * @param count the number of values.
+     * @param seed the seed to try.
+     * @param size the number of slots.
+     * @param taken the slots that are taken - the slots of the values are added on success.
+     * @param slots a buffer for the slots of the values.
+     * @return true if the values were placed.
+     */
+    static bool _tryPlace(const std::uint64_t *values, const std::uint64_t &count,
+                          const std::uint32_t &seed, const std::uint64_t &size,
+                          std::vector<bool> &taken, std::vector<std::uint64_t> &slots)
+    {
+        slots.clear();
+        for (std::uint64_t i = 0; i < count; ++i)
+        {
+            const std::uint64_t slot = _slotOf(values[i], seed, size);
+            if (taken[slot] || std::find(slots.begin(), slots.end(), slot) != slots.end())
+            {
+                if (seed == 0 && _hasEqual(std::vector<std::uint64_t>(values, values + count)))
+                {
+                    throw std::invalid_argument(EQUAL_HASH_VALUES_ERROR_MSG);
+                }
+                return false;
+            }
+            slots.push_back(slot);
+        }
+        for (const std::uint64_t &slot: slots)
+        {
+            taken[slot] = true;
+        }
+        return true;
+    }
+
+    /**
+     * @param values hash values.
+     * @return true if two of the values are equal.
+     */
+    static bool _hasEqual(std::vector<std::uint64_t> values)
+    {
+        std::sort(values.begin(), values.end());
+        return std::adjacent_find(values.begin(), values.end()) != values.end();
+    }
+};
+
+/**
+ * FrozenHashMap class - immutable map built once from the pairs of a HashMap (or any range of
+ * pairs). The pairs are kept in one contiguous array, in the order of a minimal perfect hash of
+ * the hash values of their keys, with the hash value of every key next to it: a lookup computes
+ * the slot of the key, and compares the key of that slot only - there are no empty slots, no load
+ * factor and no collision chains. Iteration is a plain scan of the array.
+ * Keys with the same hash value can't be told apart by the perfect hash, so one of them gets the
+ * slot and the others are kept after the perfect hash slots, sorted by hash value - a lookup
+ * searches them only if the key of its slot has the same hash value and is not equal to it.
+ * @tparam KeyT type argument for generic key.
+ * @tparam ValueT type argument for generic value.
+ * @tparam Hash hash function object for KeyT.
+ * @tparam KeyEqual function object that compares two keys.
+ */
+template<typename KeyT, typename ValueT, typename Hash = DefaultHash<KeyT>,
+        typename KeyEqual = std::equal_to<>>
+class FrozenHashMap
+{
+    // enable an overload for key-like types, only if Hash and KeyEqual are transparent.
+    template<typename K>
+    using EnableIfKeyLike = std::enable_if_t<IsTransparent<Hash>::value &&
+                                             IsTransparent<KeyEqual>::value, K>;
+
+public:
+    typedef std::pair<const KeyT, ValueT> value_type;
+    typedef typename std::vector<value_type>::const_iterator const_iterator;
+    typedef const_iterator iterator;
+
+    /**
+     * Default constructor - an empty map.
+     */
+    FrozenHashMap() = default;
+
+    /**
+     * Constructor given a range of pairs, like the begin() and end() of a HashMap. Throws
+     * invalid_argument if two keys are equal.
+     * This function can throw bad_alloc exception.
+     * @tparam InputIt iterator to pair of KeyT and ValueT.
+     * @param first iterator to the first pair.
+     * @param last iterator to after the last pair.
+     */
+    template<typename InputIt>
+    FrozenHashMap(InputIt first, InputIt last)
+    {
+        std::vector<std::pair<KeyT, ValueT>> pairs(first, last);
+        std::vector<std::uint64_t> hashes;
+        hashes.reserve(pairs.size());
+        for (const auto &pair: pairs)
+        {
+            hashes.push_back(Hash{}(pair.first));
+        }
+        std::vector<std::size_t> byHash(pairs.size()); // the pairs, sorted by hash value.
+        for (std::size_t i = 0; i < pairs.size(); ++i)
+        {
+            byHash[i] = i;
+        }
+        std::sort(byHash.begin(), byHash.end(), [&hashes](const std::size_t &a,
+                                                          const std::size_t &b)
+        { return hashes[a] < hashes[b]; });
+        std::vector<std::uint64_t> distinct; // the hash values, each once.
+        std::vector<std::size_t> firsts, overflow; // the first pair of every hash value, the rest.
+        for (std::size_t i = 0, group = 0; i < byHash.size(); ++i)
+        {
+            if (i == 0 || hashes[byHash[i]] != hashes[byHash[i - 1]])
+            {
+                group = i;
+                distinct.push_back(hashes[byHash[i]]);
+                firsts.push_back(byHash[i]);
+                continue;
+            }
+            for (std::size_t j = group; j < i; ++j)
+            {
+                if (KeyEqual{}(pairs[byHash[j]].first, pairs[byHash[i]].first))
+                {
+                    throw std::invalid_argument(EQUAL_KEYS_ERROR_MSG);
+                }
+            }
+            overflow.push_back(byHash[i]);
+        }
+        _seeds = PerfectHash::build(distinct);
+        _perfectSlots = distinct.size();
+        std::vector<std::size_t> order(pairs.size()); // the pair of every slot.
+        for (std::size_t i = 0; i < firsts.size(); ++i)
+        {
+            order[_slotOf(distinct[i])] = firsts[i];
+        }
+        std::copy(overflow.begin(), overflow.end(), order.begin() + _perfectSlots);
+        _pairs.reserve(pairs.size());
+        _hashes.reserve(pairs.size());
+        for (const std::size_t &i: order)
+        {
+            _pairs.emplace_back(std::move(pairs[i].first), std::move(pairs[i].second));
+            _hashes.push_back(hashes[i]);
+        }
+    }
+
+    /**
+     * @return the number of pairs.
+     */
+    inline long size() const
+    { return (long) _pairs.size(); }
+
+    /**
+     * @return true if there are no pairs.
+     */
+    inline bool empty() const
+    { return _pairs.empty(); }
+
+    /**
+     * @return iterator to the first pair.
+     */
+    inline const_iterator begin() const
+    { return _pairs.begin(); }
+
+    /**
+     * @return iterator to after the last pair.
+     */
+    inline const_iterator end() const
+    { return _pairs.end(); }
+
+    /**
+     * @param key KeyT value.
+     * @return iterator to the pair with the given key, or end() if there is no such pair.
+     */
+    inline const_iterator find(const KeyT &key) const
+    { return find(key, Hash{}(key)); }
+
+    /**
+     * @param key key-like value that can be compared to KeyT.
+     * @return iterator to the pair with the given key, or end() if there is no such pair.
+     */
+    template<typename K, typename = EnableIfKeyLike<K>>
+    inline const_iterator find(const K &key) const
+    { return find(key, Hash{}(key)); }
+
+    /**
+     * Search with a hash value computed by the caller, like HashMap::find(key, hash).
+     * @param key KeyT value, or key-like value if Hash and KeyEqual are transparent.
+     * @param hash the hash value of key - must be equal to what Hash returns for it.
+     * @return iterator to the pair with the given key, or end() if there is no such pair.
+     */
+    template<typename K>
+    const_iterator find(const K &key, const std::size_t &hash) const
+    {
+        if (_pairs.empty())
+        {
+            return end();
+        }
+        const std::uint64_t slot = _slotOf(hash);
+        if (_hashes[slot] != (std::uint64_t) hash)
+        {
+            return end();
+        }
+        if (KeyEqual{}(_pairs[slot].first, key))
+        {
+            return begin() + slot;
+        }
+        // another key of the same hash value has the slot - the key may be after the slots.
+        const auto equalHashes = std::equal_range(_hashes.begin() + _perfectSlots, _hashes.end(),
+                                                  (std::uint64_t) hash);
+        for (auto current = equalHashes.first; current != equalHashes.second; ++current)
+        {
+            if (KeyEqual{}(_pairs[current - _hashes.begin()].first, key))
+            {
+                return begin() + (current - _hashes.begin());
+            }
+        }
+        return end();
+    }
+
+    /**
+     * @param key KeyT value.
+     * @return true if the key is in the map.
+     */
+    inline bool containsKey(const KeyT &key) const
+    { return find(key) != end(); }
+
+    /**
+     * @param key key-like value that can be compared to KeyT.
+     * @return true if the key is in the map.
+     */
+    template<typename K, typename = EnableIfKeyLike<K>>
+    inline bool containsKey(const K &key) const
+    { return find(key) != end(); }
+
+    /**
+     * @param key KeyT value.
+     * @return const reference to the value of the key. Throw out_of_range exception if the key is
+     * not in the map.
+     */
+    const ValueT &at(const KeyT &key) const
+    { return _existing(find(key))->second; }
+
+    /**
+     * @param key key-like value that can be compared to KeyT.
+     * @return const reference to the value of the key. Throw out_of_range exception if the key is
+     * not in the map.
+     */
+    template<typename K, typename = EnableIfKeyLike<K>>
+    const ValueT &at(const K &key) const
+    { return _existing(find(key))->second; }
+
+    /**
+     * @return the seed of every bucket of the perfect hash, for PerfectHash::slot().
+     */
+    inline const std::vector<std::uint32_t> &seeds() const
+    { return _seeds; }
+
+    /**
+     * @return the hash value of the key of every slot.
+     */
+    inline const std::vector<std::uint64_t> &hashes() const
+    { return _hashes; }
+
+    /**
+     * @return the number of slots of the perfect hash - the slots after them keep the keys whose
+     * hash value is the same as that of a key before them, sorted by hash value.
+     */
+    inline std::size_t perfectSlots() const
+    { return _perfectSlots; }
+
+private:
+    std::vector<std::uint32_t> _seeds; // the perfect hash.
+    std::vector<value_type> _pairs; // the pair of every slot.
+    std::vector<std::uint64_t> _hashes; // the hash value of the key of every slot.
+    std::size_t _perfectSlots = 0; // the slots of the perfect hash, the first ones.
+
+    /**
+     * @param hash hash value.
+     * @return the slot of the hash value.
+     */
+    inline std::uint64_t _slotOf(const std::uint64_t &hash) const
+    { return PerfectHash::slot(hash, _seeds.data(), _seeds.size(), _perfectSlots); }
+
+    /**
+     * @param position the result of find().
+     * @return position. Throw out_of_range exception if it is end().
+     */
+    const_iterator _existing(const const_iterator &position) const
+    {
+        if (position == end())
+        {
+            throw std::out_of_range(KEY_DOSENT_EXIST_ERROR);
+        }
+        return position;
+    }
+};
+
+#endif //FROZEN_HASHMAP_HPP
@@ -3,17 +3,34 @@
  * @author Aviad Dudkevich
  * @brief Implementation of HashMap class using generic keys and values.
  */
+#ifndef HASHMAP_HPP
+#define HASHMAP_HPP
+
 #include <iostream>
 #include <vector>
 #include <exception>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include "FastHash.hpp"
+#include "HashMapStats.hpp"
+#include "ChainedTable.hpp"
+#include "FlatTable.hpp"
+#include "IncrementalTable.hpp"
+#include "OrderedTable.hpp"
+#include "Prefetch.hpp"
+#include "ResizePolicy.hpp"
+#include "SmallTable.hpp"
 
 // Constants
-const long TABLE_FACTOR = 2;
 const int INITIAL_CAPACITY = 16;
 const double DEFAULT_LOWER_LOAD_FACTOR = 0.25;
 const double DEFAULT_UPPER_LOAD_FACTOR = 0.75;
 
-static const char *MEMORY_ERROR_MSG = "Memory error occurred\n";
 static const char *DIFFERENT_SIZE_VECTORS_ERROR_MSG = "HashMap constructor got vectors with"
                                                       " different sizes.";
 static const char *INVALID_LOAD_FACTORS_LOWER_HIGHER = "HashMap must have lower load factor "
@@ -26,32 +43,117 @@ static const char *KEY_DOSENT_EXIST_ERROR = "HashMap doesn't have an element wit
 using std::vector;
 using std::pair;
 
+/**
+ * Default hash function object of HashMap - std::hash of KeyT.
+ * @tparam KeyT type argument for generic key.
+ */
+template<typename KeyT>
+struct DefaultHash : std::hash<KeyT>
+{
+};
+
+/**
+ * Default hash function object of HashMap for std::string keys. It is transparent - hashes any
+ * type convertible to std::string_view the same as the equal std::string, so lookups can be done
+ * without constructing a string.
+ */
+template<>
+struct DefaultHash<std::string>
+{
+    typedef void is_transparent;
+
+    inline std::size_t operator()(const std::string_view &key) const noexcept
+    { return std::hash<std::string_view>{}(key); }
+};
+
+/**
+ * Check if a function object supports key-like arguments (has is_transparent member type).
+ * @tparam T function object type.
+ */
+template<typename T, typename = void>
+struct IsTransparent : std::false_type
+{
+};
+
+template<typename T>
+struct IsTransparent<T, std::void_t<typename T::is_transparent>> : std::true_type
+{
+};
+
 /**
  * HashMap class - implementation of hash table database similar to STL interface.
- * @tparam KeyT type argument for generic key. Assumptions: have copy constructor, == operator
- * between two KeyT, support std::hash.
+ * @tparam KeyT type argument for generic key. Assumptions: have copy constructor, supported by
+ * Hash and KeyEqual. With std::string keys, containsKey() and at() also accept std::string_view
+ * (or anything comparable to KeyT with KeyEqual that Hash accepts), without constructing a KeyT.
  * @tparam ValueT type argument for generic value. Assumptions: have copy constructor, default
- * constructor.
+ * constructor. Move-only values work too, as long as the HashMap is not copied - rehash moves
+ * the pairs, and rvalue keys and values are moved into the HashMap.
+ * @tparam Hash hash function object for KeyT, default constructible. DefaultHash (default) is
+ * std::hash, FastHash is faster for strings and spreads integer keys over all the bits.
+ * @tparam KeyEqual function object that compares two keys, default constructible. The default
+ * uses the == operator.
+ * @tparam Allocator allocator of pairs, the std::allocator interface. All the memory of the
+ * HashMap is allocated by it (or by its rebound copies). ArenaAllocator takes it from an Arena,
+ * so the whole HashMap is freed at once with the arena. Allocation failures throw bad_alloc,
+ * and leave the HashMap as it was.
+ * @tparam Storage storage policy - how the pairs are kept in memory. ChainedStorage (default)
+ * keeps a vector per bucket, FlatStorage keeps all the pairs in one array with open addressing,
+ * which is faster and smaller for read-mostly maps. CachedChainedStorage and CachedFlatStorage
+ * also keep the hash value of every key, so rehash doesn't hash the keys again, and lookups
+ * compare keys only if the hash values are equal - good for keys that are expensive to hash or
+ * compare, like long strings. OrderedStorage keeps the pairs in insertion order in one array,
+ * with a separate index, so iteration is in the same order on every run and a copy is two array
+ * copies. IncrementalStorage<Storage> resizes any of them a few pairs at a time instead of all at
+ * once, so no single insert or erase pays for moving the whole table - with OrderedStorage, the
+ * order is kept only between resizes. SmallStorage<Storage, N> keeps up to N pairs inside the
+ * HashMap object and searches them linearly, and allocates a table of Storage only for more - for
+ * the many maps that stay tiny.
+ * @tparam Resize resize policy - when to shrink the table. EagerShrink (default) shrinks as soon
+ * as the load factor is under the lower load factor, HysteresisShrink waits until the smaller
+ * table is far enough from the upper load factor, and ExplicitShrink shrinks only in
+ * shrink_to_fit(). All of them grow when the load factor would be above the upper load factor.
  */
-template<typename KeyT, typename ValueT>
+template<typename KeyT, typename ValueT, typename Hash = DefaultHash<KeyT>,
+        typename KeyEqual = std::equal_to<>,
+        typename Allocator = std::allocator<std::pair<KeyT, ValueT>>,
+        typename Storage = ChainedStorage, typename Resize = EagerShrink>
 class HashMap
 {
+    typedef typename Storage::template Table<KeyT, ValueT, Hash, KeyEqual, Allocator> Table;
+    typedef typename Table::Position Position;
+
+    // enable an overload for key-like types, only if Hash and KeyEqual are transparent.
+    template<typename K>
+    using EnableIfKeyLike = std::enable_if_t<IsTransparent<Hash>::value &&
+                                             IsTransparent<KeyEqual>::value, K>;
+
 public:
+    typedef Allocator allocator_type;
+
     /**
      * Default constructor.
      */
     HashMap() : HashMap(DEFAULT_LOWER_LOAD_FACTOR, DEFAULT_UPPER_LOAD_FACTOR)
     {}
 
+    /**
+     * Constructor given an allocator.
+     * @param allocator the allocator of the HashMap.
+     */
+    explicit HashMap(const Allocator &allocator) :
+            HashMap(DEFAULT_LOWER_LOAD_FACTOR, DEFAULT_UPPER_LOAD_FACTOR, allocator)
+    {}
+
     /**
      * Constructor given lower and upper load factor.
      * @param lowerLoadFactor double.
      * @param upperLoadFactor double.
+     * @param allocator the allocator of the HashMap.
      */
-    HashMap(const double &lowerLoadFactor, const double &upperLoadFactor) try :
-            _capacity(INITIAL_CAPACITY), _size(0), _upperLoadFactor(upperLoadFactor),
-            _lowerLoadFactor(lowerLoadFactor),
-            _table(new vector<pair<KeyT, ValueT>>[_capacity])
+    HashMap(const double &lowerLoadFactor, const double &upperLoadFactor,
+            const Allocator &allocator = Allocator()) :
+            _upperLoadFactor(upperLoadFactor), _lowerLoadFactor(lowerLoadFactor),
+            _table(INITIAL_CAPACITY, allocator)
     {
         if (_upperLoadFactor < _lowerLoadFactor)
         {
@@ -62,112 +164,106 @@ public:
             throw std::invalid_argument(INVALID_LOAD_FACTORS_OUT_RANGE);
         }
     }
-    catch (std::bad_alloc &ex)
-    {
-        std::cerr << MEMORY_ERROR_MSG;
-        exit(EXIT_FAILURE);
-    }
 
     /**
      * Constructor given a vector of keys and vector of values as initial input.
      * If the vectors have a different size, or vector key have two or more identical keys - throw
      * invalid_argument exception.
+     * The capacity is set once for all the input, so there is no rehash while inserting.
      * @param keyVector vector of KeyT.
      * @param valueVector vector of ValueT.
+     * @param allocator the allocator of the HashMap.
      */
-    HashMap(const vector<KeyT> &keyVector, const vector<ValueT> &valueVector) : HashMap()
+    HashMap(const vector<KeyT> &keyVector, const vector<ValueT> &valueVector,
+            const Allocator &allocator = Allocator()) : HashMap(allocator)
     {
         if (keyVector.size() != valueVector.size())
         {
             throw std::invalid_argument(DIFFERENT_SIZE_VECTORS_ERROR_MSG);
         }
-        for (int i = 0; i < keyVector.size(); ++i)
+        reserve((long) keyVector.size());
+        for (size_t i = 0; i < keyVector.size(); ++i)
         {
-            if (containsKey(keyVector[i])) // if a same key appears again,
-                // the new corresponding value should overwrite the old one.
-            {
-                vector<pair<KeyT, ValueT>> &bucket = _table[_getIndex(keyVector[i], _capacity)];
-                for (auto j = bucket.begin(); j != bucket.end(); ++j)
-                {
-                    if (j->first == keyVector[i])
-                    {
-                        j->second = valueVector[i];
-                    }
-                }
-            }
-            else
-            {
-                _addToTable(keyVector[i], valueVector[i], _table, _capacity);
-                ++_size;
-            }
+            // if a same key appears again, the new corresponding value should overwrite the old
+            // one.
+            insert_or_assign(keyVector[i], valueVector[i]);
         }
-        _keepUpperLoadFactor();
     }
 
     /**
-     * Copy constructor.
-     * @param other anther HashMap with the same KeyT and ValueT.
+     * Constructor given a range of pairs as initial input. If a same key appears again, the new
+     * corresponding value overwrite the old one. If the range can be passed more than once
+     * (forward iterators), the capacity is set once for all the input, so there is no rehash
+     * while inserting.
+     * @tparam InputIt iterator to pair of (KeyT, ValueT).
+     * @param first iterator to the first pair.
+     * @param last iterator to after the last pair.
+     * @param allocator the allocator of the HashMap.
      */
-    HashMap(const HashMap<KeyT, ValueT> &other) try :
-            _capacity(other._capacity), _size(other._size),
-            _upperLoadFactor(other._upperLoadFactor), _lowerLoadFactor(other._lowerLoadFactor),
-            _table(new vector<pair<KeyT, ValueT>>[_capacity])
+    template<typename InputIt,
+            typename = typename std::iterator_traits<InputIt>::iterator_category>
+    HashMap(InputIt first, InputIt last, const Allocator &allocator = Allocator()) :
+            HashMap(allocator)
     {
-        for (const pair<KeyT, ValueT> &p: other)
+        if (std::is_base_of<std::forward_iterator_tag,
+                typename std::iterator_traits<InputIt>::iterator_category>::value)
         {
-            _addToTable(p.first, p.second, _table, _capacity);
+            reserve((long) std::distance(first, last));
+        }
+        for (; first != last; ++first)
+        {
+            const auto &element = *first;
+            insert_or_assign(element.first, element.second);
         }
     }
-    catch (std::bad_alloc &ex)
-    {
-        std::cerr << MEMORY_ERROR_MSG;
-        exit(EXIT_FAILURE);
-    }
+
+    /**
+     * Copy constructor.
+     * @param other anther HashMap with the same KeyT and ValueT.
+     */
+    HashMap(const HashMap &other) :
+            _upperLoadFactor(other._upperLoadFactor), _lowerLoadFactor(other._lowerLoadFactor),
+            _table(other._table)
+    {}
 
     /**
      * Move constructor.
      * @param other rvalue reference to HashMap with the same KeyT and ValueT.
      */
-    HashMap(HashMap<KeyT, ValueT> && other) noexcept : _capacity(other._capacity),
-                                                      _size(other._size),
-                                                      _upperLoadFactor(other._upperLoadFactor),
-                                                      _lowerLoadFactor(other._lowerLoadFactor),
-                                                      _table(other._table)
-    {
-        other._table = nullptr;
-    }
+    HashMap(HashMap &&other) noexcept :
+            _upperLoadFactor(other._upperLoadFactor), _lowerLoadFactor(other._lowerLoadFactor),
+            _table(std::move(other._table))
+    {}
 
     /**
-     * Destructor.
+     * @return the allocator of the HashMap.
      */
-    ~HashMap()
-    {
-        delete[] _table;
-    }
+    inline Allocator get_allocator() const
+    { return _table.get_allocator(); }
 
     /**
      * @return the number of elements in the HashMap.
      */
     inline int size() const
-    { return (int) _size; }
+    { return (int) _table.size(); }
 
     /**
      * @return HashMap capacity.
      */
     inline int capacity() const
-    { return (int) _capacity; }
+    { return (int) _table.capacity(); }
 
     /**
      * @return HashMap load factor in double.
      */
     inline double getLoadFactor() const
-    { return (double) _size / _capacity; }
+    { return (double) _table.size() / _table.capacity(); }
 
     /**
      * @return true if HashTable is empty, false otherwise.
      */
     inline bool empty() const
-    { return _size == 0; }
+    { return _table.size() == 0; }
 
     /**
      * Insert new value to the HashMap.
@@ -176,20 +272,18 @@ public:
      * @return true if the value added successfully to the HashMap, false otherwise (in case
      * HashMap already have element with the same key).
      */
-    bool insert(const KeyT &key, const ValueT &value)
-    {
-        if (containsKey(key))
-        {
-            return false;
-        }
-        else
-        {
-            _addToTable(key, value, _table, _capacity);
-            ++_size;
-            _keepUpperLoadFactor();
-        }
-        return true;
-    }
+    inline bool insert(const KeyT &key, const ValueT &value)
+    { return _tryEmplace(key, std::forward_as_tuple(value)).second; }
+
+    /**
+     * Insert new value to the HashMap, moving the key and the value into it.
+     * @param key rvalue reference to KeyT, moved only if the pair is added.
+     * @param value rvalue reference to ValueT, moved only if the pair is added.
+     * @return true if the value added successfully to the HashMap, false otherwise (in case
+     * HashMap already have element with the same key).
+     */
+    inline bool insert(KeyT &&key, ValueT &&value)
+    { return _tryEmplace(std::move(key), std::forward_as_tuple(std::move(value))).second; }
 
     /**
      * Removing an element with the given key.
@@ -198,39 +292,30 @@ public:
      */
     bool erase(const KeyT &key)
     {
-        vector<pair<KeyT, ValueT>> &bucket = _table[_getIndex(key, _capacity)];
-        for (auto i = bucket.begin(); i != bucket.end(); ++i)
+        const Position position = _find(key, Table::hashOf(key));
+        if (position == _table.end())
         {
-            if (i->first == key)
-            {
-                bucket.erase(i);
-                --_size;
-                _keepLowerLoadFactor();
-                return true;
-            }
+            return false;
         }
-        return false;
+        _table.erase(position);
+        _keepLowerLoadFactor();
+        return true;
     }
 
     /**
      * @param key KeyT value.
      * @return true if HashMap contain an element with this key.
      */
-    bool containsKey(const KeyT &key) const
-    {
-        vector<pair<KeyT, ValueT>> &bucket = _table[_getIndex(key, _capacity)];
-        if (bucket.size() > 0)
-        {
-            for (pair<KeyT, ValueT> &p: bucket)
-            {
-                if (p.first == key)
-                {
-                    return true;
-                }
-            }
-        }
-        return false;
-    }
+    inline bool containsKey(const KeyT &key) const
+    { return _find(key, Table::hashOf(key)) != _table.end(); }
+
+    /**
+     * @param key key-like value that can be compared to KeyT.
+     * @return true if HashMap contain an element with this key.
+     */
+    template<typename K, typename = EnableIfKeyLike<K>>
+    inline bool containsKey(const K &key) const
+    { return _find(key, Table::hashOf(key)) != _table.end(); }
 
     /**
      * @param key KeyT value.
@@ -238,17 +323,7 @@ public:
      * exception if HashMap doesn't contains the key.
      */
     const ValueT &at(const KeyT &key) const
-    {
-        vector<pair<KeyT, ValueT>> &bucket = _table[_getIndex(key, _capacity)];
-        for (auto &i: bucket)
-        {
-            if (i.first == key)
-            {
-                return i.second;
-            }
-        }
-        throw std::out_of_range(KEY_DOSENT_EXIST_ERROR);
-    }
+    { return _table.get(_findExisting(key)).second; }
 
     /**
      * @param key KeyT value.
@@ -256,40 +331,41 @@ public:
      * exception if HashMap doesn't contains the key.
      */
     ValueT &at(const KeyT &key)
-    {
-        // I was too lazy to find a way to avoid copying and pasting the same code. sorry.
-        vector<pair<KeyT, ValueT>> &bucket = _table[_getIndex(key, _capacity)];
-        for (auto &i: bucket)
-        {
-            if (i.first == key)
-            {
-                return i.second;
-            }
-        }
-        throw std::out_of_range(KEY_DOSENT_EXIST_ERROR);
-    }
+    { return _table.get(_findExisting(key)).second; }
+
+    /**
+     * @param key key-like value that can be compared to KeyT.
+     * @return const reference to the value of the element with the given key. Throw out_of_range
+     * exception if HashMap doesn't contains the key.
+     */
+    template<typename K, typename = EnableIfKeyLike<K>>
+    const ValueT &at(const K &key) const
+    { return _table.get(_findExisting(key)).second; }
+
+    /**
+     * @param key key-like value that can be compared to KeyT.
+     * @return reference to the value of the element with the given key. Throw out_of_range
+     * exception if HashMap doesn't contains the key.
+     */
+    template<typename K, typename = EnableIfKeyLike<K>>
+    ValueT &at(const K &key)
+    { return _table.get(_findExisting(key)).second; }
 
     /**
      * @param key KeyT value.
      * @return reference to the value with the given key. If key is not in HashMap - insert key
      * and return a reference to the value.
      */
-    ValueT &operator[](const KeyT &key)
-    {
-        vector<pair<KeyT, ValueT>> &bucket = _table[_getIndex(key, _capacity)];
-        for (auto &i: bucket)
-        {
-            if (i.first == key)
-            {
-                return i.second;
-            }
-        }
-        // key is not on the table.
-        bucket.push_back(std::pair<KeyT, ValueT>(key, ValueT()));
-        ++_size;
-        _keepUpperLoadFactor();
-        return operator[](key);
-    }
+    inline ValueT &operator[](const KeyT &key)
+    { return _table.get(_tryEmplace(key, std::tuple<>()).first).second; }
+
+    /**
+     * @param key rvalue reference to KeyT, moved only if it is not in HashMap.
+     * @return reference to the value with the given key. If key is not in HashMap - insert key
+     * and return a reference to the value.
+     */
+    inline ValueT &operator[](KeyT &&key)
+    { return _table.get(_tryEmplace(std::move(key), std::tuple<>()).first).second; }
 
     /**
      * @param key KeyT value.
@@ -300,7 +376,7 @@ public:
     {
         if (containsKey(key))
         {
-            return (int) _table[_getIndex(key, _capacity)].size();
+            return (int) _table.bucketSize(Table::hashOf(key));
         }
         else // I personally don't understand why to throw an exception if key is not on th HashMap.
             // In my opinion it should return the size of the bucket regardless if the bucket
@@ -311,15 +387,56 @@ public:
     }
 
     /**
-     * Erase all elements in HashMap.
+     * Erase all elements in HashMap. The capacity is kept - call shrink_to_fit() to release it.
+     */
+    inline void clear()
+    { _table.clear(); }
+
+    /**
+     * Change the capacity to the smallest power of 2 that is big enough for the current elements
+     * without crossing the upper load factor, regardless of the resize policy.
      */
-    void clear()
+    inline void shrink_to_fit()
+    { rehash(0); }
+
+    /**
+     * Make the capacity big enough for count elements without crossing the upper load factor, so
+     * adding up to count elements doesn't rehash.
+     * @param count the number of elements the HashMap should hold.
+     */
+    inline void reserve(const long &count)
+    { _keepUpperLoadFactor(count); }
+
+    /**
+     * Change the capacity to the smallest power of 2 that is at least count, and is big enough
+     * for the current elements without crossing the upper load factor, and rehash.
+     * @param count the minimal capacity.
+     */
+    void rehash(const long &count)
     {
-        for (long i = 0; i < _capacity; ++i)
+        long newCapacity = 1;
+        while (newCapacity < count || ((double) _table.size() / newCapacity) > _upperLoadFactor)
+        {
+            newCapacity *= TABLE_FACTOR;
+        }
+        if (newCapacity != _table.capacity())
         {
-            _table[i].clear();
+            _rehash(newCapacity);
         }
-        _size = 0;
+    }
+
+    /**
+     * @return the lengths of the buckets, and, if compiled with HASHMAP_STATS, the number of
+     * searches and rehashes since this HashMap was constructed. Every pair asks the table for
+     * the length of its bucket, so it takes time in proportion to the pairs and their buckets.
+     */
+    HashMapStats stats() const
+    {
+        HashMapStats result = HashMapStats::of(_table);
+#ifdef HASHMAP_STATS
+        _stats.addTo(result);
+#endif
+        return result;
     }
 
     /**
@@ -327,7 +444,7 @@ public:
      * @param other anther HashMap with the same KeyT and ValueT.
      * @return a reference to this.
      */
-    HashMap<KeyT, ValueT> &operator=(HashMap<KeyT, ValueT> other)
+    HashMap &operator=(HashMap other)
     {
         swap(*this, other);
         return *this;
@@ -338,24 +455,18 @@ public:
      * @param other anther HashMap with the same KeyT and ValueT.
      * @return true if the two HashMap have the same pairs of (KeyT, ValueT), false otherwise.
      */
-    bool operator==(const HashMap<KeyT, ValueT> &other) const
+    bool operator==(const HashMap &other) const
     {
-        if (_size == other._size &&
+        if (size() == other.size() &&
             _upperLoadFactor == other._upperLoadFactor &&
             _lowerLoadFactor == other._lowerLoadFactor &&
-            _capacity == other._capacity) // personally I think that capacity is not
+            capacity() == other.capacity()) // personally I think that capacity is not
             // differentiate factor.
         {
             for (const pair<KeyT, ValueT> &p: other)
             {
-                try
-                {
-                    if (at(p.first) != p.second)
-                    {
-                        return false;
-                    }
-                }
-                catch (std::out_of_range &ex)
+                const Position position = _find(p.first, Table::hashOf(p.first));
+                if (position == _table.end() || _table.get(position).second != p.second)
                 {
                     return false;
                 }
@@ -370,56 +481,107 @@ public:
      * @param other anther HashMap with the same KeyT and ValueT.
      * @return false if the two HashMap have the same pairs of (KeyT, ValueT), true otherwise.
      */
-    inline bool operator!=(const HashMap<KeyT, ValueT> &other) const
+    inline bool operator!=(const HashMap &other) const
     {
         return !(*this == other);
     }
 
     /**
-     * HashMap Iterator class - pointer to pair.
+     * The pair an iterator points to - a reference to its key, which can't change (that would lose
+     * the pair in the table), and to its value, which can. Converts to a copy of the pair.
+     */
+    struct PairReference
+    {
+        const KeyT &first;
+        ValueT &second;
+
+        /**
+         * @return a copy of the pair.
+         */
+        inline operator pair<KeyT, ValueT>() const
+        { return pair<KeyT, ValueT>(first, second); }
+    };
+
+    /**
+     * HashMap Iterator class - pointer to pair. iterator can change the values of the pairs it
+     * points to, through a PairReference - not their keys - and converts to const_iterator, which
+     * can't. A PairReference is returned by value, so a loop over a HashMap that isn't const takes
+     * its pairs by auto && or const auto &.
+     * @tparam Const true for const_iterator.
      */
+    template<bool Const>
     class PointerToPair
     {
-    public:
+        typedef std::conditional_t<Const, const Table, Table> TableType;
+
         /**
-         * Constructor given a HashMap and flag for end.
-         * @param hashMap The HashMap to point to its elements.
-         * @param end true if point to the end of HashMap, true otherwise.
+         * The result of operator->() of iterator - it keeps the PairReference the arrow points to.
          */
-        PointerToPair(const HashMap<KeyT, ValueT> &hashMap, const bool &end) : _hashMap(hashMap),
-                                                                               _end(end),
-                                                                               _bucketIndex(0),
-                                                                               _vectorIterator()
+        struct Arrow
         {
-            _getNextBucketAndIterator();
-            if (_end)
-            {
-                _vectorIterator = _hashMap._table[_hashMap._capacity - 1].end();
-            }
-        }
+            PairReference pair;
+
+            inline const PairReference *operator->() const
+            { return &pair; }
+        };
+
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef pair<KeyT, ValueT> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef std::conditional_t<Const, const value_type *, Arrow> pointer;
+        typedef std::conditional_t<Const, const value_type &, PairReference> reference;
 
         /**
-         * copy constructor.
-         * @param other another PointerToPair.
+         * Constructor given a table and a position in it.
+         * @param table The table of the HashMap to point to its elements.
+         * @param position position of a pair in the table, or the end position of the table.
          */
-        PointerToPair(const PointerToPair &other) : _hashMap(other._hashMap), _end(other._end),
-                                                    _bucketIndex(other._bucketIndex),
-                                                    _vectorIterator(other._vectorIterator)
+        PointerToPair(TableType &table, const Position &position) : _table(&table),
+                                                                    _position(position)
+        {}
+
+        /**
+         * Conversion from iterator to const_iterator.
+         * @param other iterator.
+         */
+        template<bool OtherConst, typename = std::enable_if_t<Const && !OtherConst>>
+        PointerToPair(const PointerToPair<OtherConst> &other) : _table(other._table),
+                                                                _position(other._position)
         {}
 
         /**
          * * operator.
-         * @return dereference to const pair.
+         * @return dereference to the pair.
          */
-        inline const pair<KeyT, ValueT> &operator*() const
-        { return *_vectorIterator; }
+        inline reference operator*() const
+        {
+            if constexpr (Const)
+            {
+                return _table->get(_position);
+            }
+            else
+            {
+                value_type &element = _table->get(_position);
+                return PairReference{element.first, element.second};
+            }
+        }
 
         /**
          * -> operator.
-         * @return const address to the pair.
+         * @return address to the pair.
          */
-        inline const pair<KeyT, ValueT> *operator->() const
-        { return &*_vectorIterator; }
+        inline pointer operator->() const
+        {
+            if constexpr (Const)
+            {
+                return &_table->get(_position);
+            }
+            else
+            {
+                return Arrow{**this};
+            }
+        }
 
         /**
          * prefix operator ++.
@@ -427,12 +589,7 @@ public:
          */
         PointerToPair &operator++()
         {
-            ++_vectorIterator;
-            if (_vectorIterator == _hashMap._table[_bucketIndex].end())
-            {
-                ++_bucketIndex;
-                _getNextBucketAndIterator();
-            }
+            _position = _table->next(_position);
             return *this;
         }
 
@@ -449,172 +606,426 @@ public:
 
         /**
          * compare operator.
-         * @param other another PointerToPair
+         * @param other another PointerToPair, const or not.
          * @return true if point to the same pair in the same HashMap, false otherwise.
          */
-        inline bool operator==(const PointerToPair &other) const
-        {
-            return &_hashMap == &other._hashMap &&
-                   ((_end && other._end) || _vectorIterator == other._vectorIterator);
-        }
+        template<bool OtherConst>
+        inline bool operator==(const PointerToPair<OtherConst> &other) const
+        { return _table == other._table && _position == other._position; }
 
         /**
          * compare operator.
-         * @param other another PointerToPair
+         * @param other another PointerToPair, const or not.
          * @return false if point to the same pair in the same HashMap, true otherwise.
          */
-        inline bool operator!=(const PointerToPair &other) const
+        template<bool OtherConst>
+        inline bool operator!=(const PointerToPair<OtherConst> &other) const
         { return !(*this == other); }
 
     private:
-        const HashMap<KeyT, ValueT> &_hashMap; // the HashMap the PointerToPair belong to.
-        bool _end; // flag to indicate the end of map.
-        long _bucketIndex; // the current bucket the pointer at.
-        typename vector<pair<KeyT, ValueT>>::iterator _vectorIterator; // Iterator of the bucket.
+        template<bool> friend class PointerToPair;
 
-        /**
-         * Get to the next bucket that is not empty and get the iterator of that bucket.
-         */
-        void _getNextBucketAndIterator()
-        {
-            while (_bucketIndex < _hashMap._capacity && _hashMap._table[_bucketIndex].empty())
-            {
-                ++_bucketIndex;
-            }
-            if (_bucketIndex != _hashMap._capacity)
-            {
-                _vectorIterator = _hashMap._table[_bucketIndex].begin();
-            }
-            else
-            {
-                _vectorIterator = _hashMap._table[_hashMap._capacity - 1].end();
-                _end = true;
-            }
-        }
+        TableType *_table; // the table of the HashMap the PointerToPair belong to.
+        Position _position; // the position of the pair in the table.
     };
 
-    typedef PointerToPair iterator;
-    typedef PointerToPair const_iterator;
+    typedef PointerToPair<false> iterator;
+    typedef PointerToPair<true> const_iterator;
 
     /**
      * Get iterator to the first pair in HashMap.
      * @return PointerToPair with pointer to the first pair.
      */
-    const iterator begin() const
-    { return iterator(*this, false); }
+    inline iterator begin()
+    { return iterator(_table, _table.begin()); }
 
     /**
      * Get iterator to the first pair in HashMap.
      * @return PointerToPair with pointer to the first pair.
      */
-    inline const const_iterator cbegin() const
+    inline const_iterator begin() const
+    { return const_iterator(_table, _table.begin()); }
+
+    /**
+     * Get iterator to the first pair in HashMap.
+     * @return PointerToPair with pointer to the first pair.
+     */
+    inline const_iterator cbegin() const
     { return begin(); }
 
     /**
      * Get iterator to after the last pair.
      * @return PointerToPair with pointer to the next position after the last pair.
      */
-    const iterator end() const
-    { return iterator(*this, true); }
+    inline iterator end()
+    { return iterator(_table, _table.end()); }
+
+    /**
+     * Get iterator to after the last pair.
+     * @return PointerToPair with pointer to the next position after the last pair.
+     */
+    inline const_iterator end() const
+    { return const_iterator(_table, _table.end()); }
 
     /**
      * Get iterator to after the last pair.
      * @return PointerToPair with pointer to the next position after the last pair.
      */
-    const const_iterator cend() const
+    inline const_iterator cend() const
     { return end(); }
 
+    /**
+     * @param key KeyT value.
+     * @return iterator to the pair with the given key, or end() if HashMap doesn't contains the
+     * key.
+     */
+    inline iterator find(const KeyT &key)
+    { return iterator(_table, _find(key, Table::hashOf(key))); }
+
+    /**
+     * @param key key-like value that can be compared to KeyT.
+     * @return iterator to the pair with the given key, or end() if HashMap doesn't contains the
+     * key.
+     */
+    template<typename K, typename = EnableIfKeyLike<K>>
+    inline iterator find(const K &key)
+    { return iterator(_table, _find(key, Table::hashOf(key))); }
+
+    /**
+     * @param key KeyT value.
+     * @return iterator to the pair with the given key, or end() if HashMap doesn't contains the
+     * key.
+     */
+    inline const_iterator find(const KeyT &key) const
+    { return const_iterator(_table, _find(key, Table::hashOf(key))); }
+
+    /**
+     * @param key key-like value that can be compared to KeyT.
+     * @return iterator to the pair with the given key, or end() if HashMap doesn't contains the
+     * key.
+     */
+    template<typename K, typename = EnableIfKeyLike<K>>
+    inline const_iterator find(const K &key) const
+    { return const_iterator(_table, _find(key, Table::hashOf(key))); }
+
+    /**
+     * Search with a hash value computed by the caller, so the key is not hashed again - for
+     * callers that get the hash value cheaper than Hash would, like a rolling hash.
+     * @param key KeyT value.
+     * @param hash the hash value of key - must be equal to what Hash returns for it.
+     * @return iterator to the pair with the given key, or end() if HashMap doesn't contains the
+     * key.
+     */
+    inline const_iterator find(const KeyT &key, const std::size_t &hash) const
+    { return const_iterator(_table, _find(key, hash)); }
+
+    /**
+     * Search with a hash value computed by the caller, so the key is not hashed again - for
+     * callers that get the hash value cheaper than Hash would, like a rolling hash.
+     * @param key key-like value that can be compared to KeyT.
+     * @param hash the hash value of key - must be equal to what Hash returns for it.
+     * @return iterator to the pair with the given key, or end() if HashMap doesn't contains the
+     * key.
+     */
+    template<typename K, typename = EnableIfKeyLike<K>>
+    inline const_iterator find(const K &key, const std::size_t &hash) const
+    { return const_iterator(_table, _find(key, hash)); }
+
+    /**
+     * Start loading the memory a lookup of the given hash value reads first, without waiting for
+     * it - for callers that know their next keys, so their cache misses overlap.
+     * @param hash the hash value of a key.
+     */
+    inline void prefetch(const std::size_t &hash) const
+    { _table.prefetch(hash); }
+
+    /**
+     * Search many keys at once. The keys are taken in groups of PREFETCH_DISTANCE: a group is
+     * hashed and the memory of all its lookups is prefetched, and only then the keys are
+     * searched - so on a table much larger than the cache, the misses of a group are waited for
+     * together, not one after the other.
+     * @tparam K KeyT, or a type that Hash and KeyEqual take.
+     * @param keys pointer to the keys.
+     * @param count the number of keys.
+     * @param results pointer to count iterators - set to the pair with every key, or end().
+     */
+    template<typename K>
+    void findBatch(const K *keys, const std::size_t &count, const_iterator *results) const
+    {
+        _searchBatch(keys, count, [this, results](const std::size_t &i, const Position &position)
+        { results[i] = const_iterator(_table, position); });
+    }
+
+    /**
+     * Check many keys at once, with the prefetching of findBatch().
+     * @tparam K KeyT, or a type that Hash and KeyEqual take.
+     * @param keys pointer to the keys.
+     * @param count the number of keys.
+     * @param results pointer to count bools - set to true for every key in HashMap.
+     */
+    template<typename K>
+    void containsBatch(const K *keys, const std::size_t &count, bool *results) const
+    {
+        _searchBatch(keys, count, [this, results](const std::size_t &i, const Position &position)
+        { results[i] = position != _table.end(); });
+    }
+
+    /**
+     * Insert a new pair, with a value constructed from the given arguments, if the key is not in
+     * HashMap. The value is not constructed if the key is already in HashMap.
+     * @param key KeyT value.
+     * @param args arguments for ValueT constructor.
+     * @return pair of iterator to the pair with that key, and true if it was added.
+     */
+    template<typename... Args>
+    inline pair<iterator, bool> try_emplace(const KeyT &key, Args &&... args)
+    { return _toIterator(_tryEmplace(key, std::forward_as_tuple(std::forward<Args>(args)...))); }
+
+    /**
+     * Insert a new pair, with a value constructed from the given arguments, if the key is not in
+     * HashMap. The key is moved and the value is constructed only if the pair is added.
+     * @param key rvalue reference to KeyT.
+     * @param args arguments for ValueT constructor.
+     * @return pair of iterator to the pair with that key, and true if it was added.
+     */
+    template<typename... Args>
+    inline pair<iterator, bool> try_emplace(KeyT &&key, Args &&... args)
+    {
+        return _toIterator(_tryEmplace(std::move(key),
+                                       std::forward_as_tuple(std::forward<Args>(args)...)));
+    }
+
+    /**
+     * Construct a pair from the given arguments and insert it, if its key is not in HashMap.
+     * The pair is moved into the HashMap.
+     * @param args arguments for pair<KeyT, ValueT> constructor.
+     * @return pair of iterator to the pair with that key, and true if it was added.
+     */
+    template<typename... Args>
+    pair<iterator, bool> emplace(Args &&... args)
+    {
+        pair<KeyT, ValueT> element(std::forward<Args>(args)...);
+        return _toIterator(_tryEmplace(std::move(element.first),
+                                       std::forward_as_tuple(std::move(element.second))));
+    }
+
+    /**
+     * Piecewise emplace - construct the key from the first tuple, and only if it is not in
+     * HashMap construct the value in place from the second tuple.
+     * @param keyArgs tuple of arguments for KeyT constructor.
+     * @param valueArgs tuple of arguments for ValueT constructor.
+     * @return pair of iterator to the pair with that key, and true if it was added.
+     */
+    template<typename... KeyArgs, typename... ValueArgs>
+    pair<iterator, bool> emplace(std::piecewise_construct_t, std::tuple<KeyArgs...> keyArgs,
+                                 std::tuple<ValueArgs...> valueArgs)
+    {
+        return _toIterator(_tryEmplace(std::make_from_tuple<KeyT>(std::move(keyArgs)),
+                                       std::move(valueArgs)));
+    }
+
+    /**
+     * Insert a new pair, or assign the value if the key is already in HashMap.
+     * @param key KeyT value.
+     * @param value the value to assign.
+     * @return pair of iterator to the pair with that key, and true if it was added.
+     */
+    template<typename M>
+    inline pair<iterator, bool> insert_or_assign(const KeyT &key, M &&value)
+    { return _insertOrAssign(key, std::forward<M>(value)); }
+
+    /**
+     * Insert a new pair, or assign the value if the key is already in HashMap.
+     * @param key rvalue reference to KeyT, moved only if the pair is added.
+     * @param value the value to assign.
+     * @return pair of iterator to the pair with that key, and true if it was added.
+     */
+    template<typename M>
+    inline pair<iterator, bool> insert_or_assign(KeyT &&key, M &&value)
+    { return _insertOrAssign(std::move(key), std::forward<M>(value)); }
+
     /**
      * Aid assignment operator.
      * @param first HashMap reference.
      * @param second HashMap reference.
      */
-    friend void swap(HashMap<KeyT, ValueT> &first, HashMap<KeyT, ValueT> &second) noexcept
+    friend void swap(HashMap &first,
+                     HashMap &second) noexcept
     {
         using std::swap;
-        swap(first._capacity, second._capacity);
-        swap(first._size, second._size);
         swap(first._upperLoadFactor, second._upperLoadFactor);
         swap(first._lowerLoadFactor, second._lowerLoadFactor);
         swap(first._table, second._table);
     }
 
 private:
-    long _capacity, _size; // capacity - how many buckets. size - how many pairs in HashMap.
     double _upperLoadFactor, _lowerLoadFactor; // to determine when to change table capacity.
-    vector<pair<KeyT, ValueT>> *_table; // the table of the HashMap.
+    Table _table; // the table of the HashMap.
+#ifdef HASHMAP_STATS
+    StatsCounters _stats; // the searches and rehashes of this object - not copied.
+#endif
+
+    /**
+     * Search the table, and count the search if compiled with HASHMAP_STATS.
+     * @param key KeyT value, or a key-like value.
+     * @param hash the hash value of key.
+     * @return position of the pair with that key, or end().
+     */
+    template<typename K>
+    inline Position _find(const K &key, const std::size_t &hash) const
+    {
+        const Position position = _table.find(key, hash);
+#ifdef HASHMAP_STATS
+        _stats.search(position != _table.end());
+#endif
+        return position;
+    }
 
     /**
-     * Get index in table by key value and table size.
-     * @param key Key value.
-     * @param tableSize long.
-     * @return index in table.
+     * Rehash the table, and time it if compiled with HASHMAP_STATS.
+     * @param newCapacity the new capacity.
      */
-    inline static long _getIndex(const KeyT &key, const long &tableSize)
-    { return std::hash<KeyT>{}(key) & (tableSize - 1); }
+    inline void _rehash(const long &newCapacity)
+    {
+#ifdef HASHMAP_STATS
+        _stats.rehash([this, &newCapacity]()
+                      { _table.rehash(newCapacity); });
+#else
+        _table.rehash(newCapacity);
+#endif
+    }
 
     /**
-     * Add pair to the HashMap table.
-     * @param key KeyT value.
-     * @param value ValueT value.
-     * @param table table to add the pair to.
-     * @param tableSize the size of the table to add to.
+     * @param key KeyT value, or a key-like value.
+     * @return position of the pair with that key. Throw out_of_range exception if HashMap
+     * doesn't contains the key.
      */
-    inline static void _addToTable(const KeyT &key, const ValueT &value,
-                                   vector<pair<KeyT, ValueT>> *&table, const long &tableSize)
+    template<typename K>
+    Position _findExisting(const K &key) const
     {
-        table[_getIndex(key, tableSize)].push_back(pair<KeyT, ValueT>(key, value));
+        const Position position = _find(key, Table::hashOf(key));
+        if (position == _table.end())
+        {
+            throw std::out_of_range(KEY_DOSENT_EXIST_ERROR);
+        }
+        return position;
     }
 
     /**
-     * ReHash to HashMap - insert all pairs to a new table.
-     * @param newCapacity the capacity of the new table.
+     * Search keys in groups of PREFETCH_DISTANCE - hash and prefetch a whole group, then search
+     * it.
+     * @param keys pointer to the keys.
+     * @param count the number of keys.
+     * @param found called with the index of every key and its position, or end().
      */
-    void _reHash(const long &newCapacity)
+    template<typename K, typename Function>
+    void _searchBatch(const K *keys, const std::size_t &count, Function found) const
     {
-        try
+        std::size_t hashes[PREFETCH_DISTANCE];
+        for (std::size_t first = 0; first < count; first += PREFETCH_DISTANCE)
         {
-            vector<pair<KeyT, ValueT>> *newTable = new vector<pair<KeyT, ValueT>>[newCapacity];
-            for (iterator i = begin(); i != end(); ++i)
+            const std::size_t groupSize = count - first < (std::size_t) PREFETCH_DISTANCE ?
+                                          count - first : (std::size_t) PREFETCH_DISTANCE;
+            for (std::size_t i = 0; i < groupSize; ++i)
             {
-                _addToTable(i->first, i->second, newTable, newCapacity);
+                hashes[i] = Table::hashOf(keys[first + i]);
+                _table.prefetch(hashes[i]);
             }
-            delete[] _table;
-            _table = newTable;
-            _capacity = newCapacity;
+            for (std::size_t i = 0; i < groupSize; ++i)
+            {
+                found(first + i, _find(keys[first + i], hashes[i]));
+            }
+        }
+    }
+
+    /**
+     * Add pair to the HashMap table if the key is not in it, first growing the table if needed.
+     * The key is hashed once, and the table is probed once unless it has to grow. The key is
+     * forwarded and the value is constructed in place, only if the pair is added.
+     * @param key KeyT value or rvalue reference.
+     * @param valueArgs tuple of arguments for ValueT constructor.
+     * @return the position of the pair with that key, and true if it was added.
+     */
+    template<typename K, typename ValueArgs>
+    pair<Position, bool> _tryEmplace(K &&key, ValueArgs &&valueArgs)
+    {
+        const std::size_t hash = Table::hashOf(key);
+        const pair<Position, bool> found = _table.findOrPrepareInsert(key, hash);
+        if (found.second)
+        {
+            return {found.first, false};
         }
-        catch (std::bad_alloc &ex)
+        const Position hint = _keepUpperLoadFactor(_table.size() + 1) ? _table.end() : found.first;
+        return {_table.emplaceAt(hint, hash, std::piecewise_construct,
+                                 std::forward_as_tuple(std::forward<K>(key)),
+                                 std::forward<ValueArgs>(valueArgs)), true};
+    }
+
+    /**
+     * Insert a new pair, or assign the value if the key is already in HashMap.
+     * @param key KeyT value or rvalue reference.
+     * @param value the value to assign.
+     * @return pair of iterator to the pair with that key, and true if it was added.
+     */
+    template<typename K, typename M>
+    pair<iterator, bool> _insertOrAssign(K &&key, M &&value)
+    {
+        // the value is forwarded only once - either to the constructor or to the assignment.
+        const pair<Position, bool> result =
+                _tryEmplace(std::forward<K>(key), std::forward_as_tuple(std::forward<M>(value)));
+        if (!result.second)
         {
-            std::cerr << MEMORY_ERROR_MSG;
-            exit(EXIT_FAILURE);
+            _table.get(result.first).second = std::forward<M>(value);
         }
+        return _toIterator(result);
     }
 
     /**
-     * check if load factor is not above _upperLoadFactor. If it does - change capacity and rehash.
+     * @param result position of a pair and if it was added.
+     * @return iterator to the pair and if it was added.
+     */
+    inline pair<iterator, bool> _toIterator(const pair<Position, bool> &result)
+    { return {iterator(_table, result.first), result.second}; }
+
+    /**
+     * check if load factor with the given number of pairs will not be above _upperLoadFactor. If
+     * it does - change capacity and rehash.
+     * @param newSize the number of pairs the table should hold.
+     * @return true if the table was rehashed.
      */
-    void _keepUpperLoadFactor()
+    bool _keepUpperLoadFactor(const long &newSize)
     {
-        if (getLoadFactor() > _upperLoadFactor)
+        const long newCapacity = Resize::grownCapacity(newSize, _table.capacity(),
+                                                       _upperLoadFactor);
+        if (newCapacity != _table.capacity())
         {
-            long newCapacity = _capacity;
-            while (((double) _size / newCapacity) > _upperLoadFactor)
-            {
-                newCapacity *= TABLE_FACTOR;
-            }
-            _reHash(newCapacity);
+            _rehash(newCapacity);
+            return true;
         }
+        return false;
     }
 
     /**
-     * check if load factor is not under _lowerLoadFactor. If it does - change capacity and rehash.
+     * check if load factor is not under _lowerLoadFactor. If it does - change capacity and rehash,
+     * when the resize policy says so.
      */
     void _keepLowerLoadFactor()
     {
-        if (getLoadFactor() < _lowerLoadFactor && _capacity != 1)
+        const long newCapacity = Resize::shrunkCapacity(_table.size(), _table.capacity(),
+                                                        _lowerLoadFactor, _upperLoadFactor);
+        if (newCapacity != _table.capacity())
         {
-            long newCapacity = _capacity / TABLE_FACTOR;
-            _reHash(newCapacity);
+            _rehash(newCapacity);
         }
     }
-};
\ No newline at end of file
+};
+
+/**
+ * HashMap with open addressing storage.
+ */
+template<typename KeyT, typename ValueT, typename Hash = DefaultHash<KeyT>,
+        typename KeyEqual = std::equal_to<>,
+        typename Allocator = std::allocator<std::pair<KeyT, ValueT>>>
+using FlatHashMap = HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator, FlatStorage>;
+
+#endif //HASHMAP_HPP
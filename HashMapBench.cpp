@@ -0,0 +1,414 @@
+/**
+ * @file HashMapBench.cpp
+ * @author Aviad Dudkevich
+ * @brief Benchmarks of HashMap and its storage engines against std::unordered_map - insert,
+ * lookup of keys that are in the map and of keys that are not, erase, iteration and rehash, for
+ * integer and string keys of a few sizes - of the lookups of FrozenHashMap, and of the lookups
+ * and updates of ConcurrentHashMap and RcuHashMap by many threads at once. Built as
+ * hashmap_bench with Google Benchmark.
+ */
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include "HashMap.hpp"
+#include "StringHashMap.hpp"
+#include "FrozenHashMap.hpp"
+#include "ConcurrentHashMap.hpp"
+#include "RcuHashMap.hpp"
+
+// Constants
+static const long MIN_SIZE = 1 << 10;
+static const long MAX_SIZE = 1 << 20; // a table of this size is much larger than the caches.
+static const int SIZE_MULTIPLIER = 32;
+static const unsigned int KEYS_SEED = 1;
+static const unsigned int MISSING_KEYS_SEED = 2;
+static const char *STRING_KEY_PREFIX = "bench/key/"; // longer than the small string buffer.
+static const int MAX_THREADS = 8;
+static const std::size_t WRITE_INTERVAL = 1024; // the searches for every write of a shared map.
+// a write to an RcuHashMap copies the table, so updates are timed on smaller tables.
+static const long MAX_UPDATE_SIZE = 1 << 15;
+
+using std::string;
+using std::vector;
+
+typedef std::uint64_t IntKey;
+
+template<typename KeyT>
+using ChainedMap = HashMap<KeyT, int>;
+template<typename KeyT>
+using FlatMap = FlatHashMap<KeyT, int>;
+template<typename KeyT>
+using CachedFlatMap = HashMap<KeyT, int, DefaultHash<KeyT>, std::equal_to<>,
+        std::allocator<std::pair<KeyT, int>>, CachedFlatStorage>;
+template<typename KeyT>
+using OrderedMap = HashMap<KeyT, int, DefaultHash<KeyT>, std::equal_to<>,
+        std::allocator<std::pair<KeyT, int>>, OrderedStorage>;
+template<typename KeyT>
+using IncrementalMap = HashMap<KeyT, int, DefaultHash<KeyT>, std::equal_to<>,
+        std::allocator<std::pair<KeyT, int>>, IncrementalStorage<>>;
+template<typename KeyT>
+using SmallMap = HashMap<KeyT, int, DefaultHash<KeyT>, std::equal_to<>,
+        std::allocator<std::pair<KeyT, int>>, SmallStorage<>>;
+template<typename KeyT>
+using StdMap = std::unordered_map<KeyT, int, DefaultHash<KeyT>>;
+typedef StringHashMap<int> StringMap;
+template<typename KeyT>
+using FrozenMap = FrozenHashMap<KeyT, int>;
+template<typename KeyT>
+using ConcurrentMap = ConcurrentHashMap<KeyT, int>;
+template<typename KeyT>
+using RcuMap = RcuHashMap<KeyT, int>;
+
+/**
+ * @param seed the seed of the keys - keys of different seeds are different.
+ * @param count the number of keys.
+ * @return distinct random integer keys.
+ */
+template<typename KeyT>
+vector<KeyT> makeKeys(const unsigned int &seed, const long &count);
+
+template<>
+vector<IntKey> makeKeys<IntKey>(const unsigned int &seed, const long &count)
+{
+    std::mt19937_64 random(seed);
+    vector<IntKey> keys((std::size_t) count);
+    for (IntKey &key: keys)
+    {
+        key = (random() << 1) | (seed & 1); // the lowest bit keeps the seeds apart.
+    }
+    return keys;
+}
+
+template<>
+vector<string> makeKeys<string>(const unsigned int &seed, const long &count)
+{
+    vector<string> keys;
+    keys.reserve((std::size_t) count);
+    for (const IntKey &number: makeKeys<IntKey>(seed, count))
+    {
+        keys.push_back(STRING_KEY_PREFIX + std::to_string(number));
+    }
+    return keys;
+}
+
+/**
+ * The operations of HashMap, on every map type - the names differ between HashMap,
+ * std::unordered_map and StringHashMap.
+ */
+template<typename Map, typename KeyT>
+inline void insertKey(Map &map, const KeyT &key, const int &value)
+{ map.insert(key, value); }
+
+template<typename KeyT>
+inline void insertKey(StdMap<KeyT> &map, const KeyT &key, const int &value)
+{ map.emplace(key, value); }
+
+inline void insertKey(StringMap &map, const string &key, const int &value)
+{ map.insert(key, value); }
+
+template<typename Map, typename KeyT>
+inline bool containsKey(const Map &map, const KeyT &key)
+{ return map.containsKey(key); }
+
+template<typename KeyT>
+inline bool containsKey(const StdMap<KeyT> &map, const KeyT &key)
+{ return map.count(key) != 0; }
+
+template<typename KeyT>
+inline bool containsKey(const RcuMap<KeyT> &map, const KeyT &key)
+{ return map.read()->containsKey(key); }
+
+template<typename Map, typename KeyT>
+inline void assignKey(Map &map, const KeyT &key, const int &value)
+{ map.insert_or_assign(key, value); }
+
+template<typename Map, typename KeyT>
+inline void eraseKey(Map &map, const KeyT &key)
+{ map.erase(key); }
+
+template<typename Map>
+inline void rehashMap(Map &map, const long &count)
+{ map.rehash(count); }
+
+/**
+ * Map every key to its index, in an empty map.
+ * @param map the map.
+ * @param keys the keys.
+ */
+template<typename Map, typename KeyT>
+void fillMap(Map &map, const vector<KeyT> &keys)
+{
+    for (std::size_t i = 0; i < keys.size(); ++i)
+    {
+        insertKey(map, keys[i], (int) i);
+    }
+}
+
+template<typename KeyT>
+void fillMap(FrozenMap<KeyT> &map, const vector<KeyT> &keys);
+
+template<typename KeyT>
+void fillMap(RcuMap<KeyT> &map, const vector<KeyT> &keys);
+
+/**
+ * @param keys the keys.
+ * @return a map from every key to its index.
+ */
+template<typename Map, typename KeyT>
+Map makeMap(const vector<KeyT> &keys)
+{
+    Map map;
+    fillMap(map, keys);
+    return map;
+}
+
+// a FrozenHashMap is built at once, from the pairs of a HashMap.
+template<typename KeyT>
+void fillMap(FrozenMap<KeyT> &map, const vector<KeyT> &keys)
+{
+    const ChainedMap<KeyT> pairs = makeMap<ChainedMap<KeyT>>(keys);
+    map = FrozenMap<KeyT>(pairs.begin(), pairs.end());
+}
+
+// an RcuHashMap copies the table on every write, so the whole table is published at once.
+template<typename KeyT>
+void fillMap(RcuMap<KeyT> &map, const vector<KeyT> &keys)
+{ map.publish(makeMap<typename RcuMap<KeyT>::Map>(keys)); }
+
+/**
+ * Insert range(0) keys into an empty map - the rehashes while it grows included.
+ */
+template<typename Map, typename KeyT>
+void benchInsert(benchmark::State &state)
+{
+    const vector<KeyT> keys = makeKeys<KeyT>(KEYS_SEED, state.range(0));
+    for (auto _: state)
+    {
+        Map map;
+        for (std::size_t i = 0; i < keys.size(); ++i)
+        {
+            insertKey(map, keys[i], (int) i);
+        }
+        benchmark::DoNotOptimize(map);
+    }
+    state.SetItemsProcessed((std::int64_t) state.iterations() * state.range(0));
+}
+
+/**
+ * Search keys of a map of range(0) keys, in a random order.
+ * @param seed KEYS_SEED for keys that are in the map, MISSING_KEYS_SEED for keys that are not.
+ */
+template<typename Map, typename KeyT>
+void benchLookup(benchmark::State &state, const unsigned int &seed)
+{
+    vector<KeyT> keys = makeKeys<KeyT>(KEYS_SEED, state.range(0));
+    const Map map = makeMap<Map>(keys);
+    if (seed != KEYS_SEED)
+    {
+        keys = makeKeys<KeyT>(seed, state.range(0));
+    }
+    std::shuffle(keys.begin(), keys.end(), std::mt19937(seed));
+    for (auto _: state)
+    {
+        long found = 0;
+        for (const KeyT &key: keys)
+        {
+            found += containsKey(map, key);
+        }
+        benchmark::DoNotOptimize(found);
+    }
+    state.SetItemsProcessed((std::int64_t) state.iterations() * state.range(0));
+}
+
+template<typename Map, typename KeyT>
+void benchLookupHit(benchmark::State &state)
+{ benchLookup<Map, KeyT>(state, KEYS_SEED); }
+
+template<typename Map, typename KeyT>
+void benchLookupMiss(benchmark::State &state)
+{ benchLookup<Map, KeyT>(state, MISSING_KEYS_SEED); }
+
+/**
+ * Erase all the keys of a map of range(0) keys, one by one - the shrinking rehashes included.
+ * Copying the map before every round is not timed.
+ */
+template<typename Map, typename KeyT>
+void benchErase(benchmark::State &state)
+{
+    const vector<KeyT> keys = makeKeys<KeyT>(KEYS_SEED, state.range(0));
+    const Map full = makeMap<Map>(keys);
+    for (auto _: state)
+    {
+        state.PauseTiming();
+        Map map(full);
+        state.ResumeTiming();
+        for (const KeyT &key: keys)
+        {
+            eraseKey(map, key);
+        }
+        benchmark::DoNotOptimize(map);
+        state.PauseTiming(); // don't time the destructor either.
+        {
+            Map destroyed(std::move(map));
+        }
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed((std::int64_t) state.iterations() * state.range(0));
+}
+
+/**
+ * Iterate over a map of range(0) keys, and sum its values.
+ */
+template<typename Map, typename KeyT>
+void benchIterate(benchmark::State &state)
+{
+    const Map map = makeMap<Map>(makeKeys<KeyT>(KEYS_SEED, state.range(0)));
+    for (auto _: state)
+    {
+        long sum = 0;
+        for (const auto &pair: map)
+        {
+            sum += pair.second;
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed((std::int64_t) state.iterations() * state.range(0));
+}
+
+/**
+ * Rehash a map of range(0) keys to 4 times the capacity it needs, and back - two rehashes a
+ * round.
+ */
+template<typename Map, typename KeyT>
+void benchRehash(benchmark::State &state)
+{
+    Map map = makeMap<Map>(makeKeys<KeyT>(KEYS_SEED, state.range(0)));
+    for (auto _: state)
+    {
+        rehashMap(map, 4 * state.range(0));
+        rehashMap(map, 0);
+        benchmark::DoNotOptimize(map);
+    }
+    state.SetItemsProcessed((std::int64_t) state.iterations() * 2 * state.range(0));
+}
+
+/**
+ * Search keys of a map of range(0) keys that all the threads share, each thread in a random order
+ * of its own. The map is built by the first thread - the threads start together after that.
+ * @param writes true to write instead of searching once every WRITE_INTERVAL keys - an
+ * insert_or_assign of a key in the map, so its size doesn't change.
+ */
+template<typename Map, typename KeyT>
+void benchShared(benchmark::State &state, const bool &writes)
+{
+    static std::unique_ptr<Map> shared;
+    vector<KeyT> keys = makeKeys<KeyT>(KEYS_SEED, state.range(0));
+    if (state.thread_index() == 0)
+    {
+        shared.reset(new Map());
+        fillMap(*shared, keys);
+    }
+    std::shuffle(keys.begin(), keys.end(), std::mt19937(KEYS_SEED + state.thread_index()));
+    for (auto _: state)
+    {
+        long found = 0;
+        for (std::size_t i = 0; i < keys.size(); ++i)
+        {
+            if (writes && i % WRITE_INTERVAL == 0)
+            {
+                assignKey(*shared, keys[i], (int) i);
+            }
+            else
+            {
+                found += containsKey(*shared, keys[i]);
+            }
+        }
+        benchmark::DoNotOptimize(found);
+    }
+    if (state.thread_index() == 0)
+    {
+        shared.reset(); // the threads stop together too.
+    }
+    state.SetItemsProcessed((std::int64_t) state.iterations() * state.range(0));
+}
+
+template<typename Map, typename KeyT>
+void benchSharedLookup(benchmark::State &state)
+{ benchShared<Map, KeyT>(state, false); }
+
+template<typename Map, typename KeyT>
+void benchSharedUpdate(benchmark::State &state)
+{ benchShared<Map, KeyT>(state, true); }
+
+/**
+ * Register a benchmark of one operation, on one map type and key type, for every size.
+ */
+#define HASHMAP_BENCH(operation, map, key) \
+    BENCHMARK_TEMPLATE(operation, map<key>, key)->RangeMultiplier(SIZE_MULTIPLIER) \
+            ->Range(MIN_SIZE, MAX_SIZE)
+
+/**
+ * Register a benchmark of one operation on a shared map, for every number of threads - the time
+ * is the wall clock time, so the items per second are of all the threads together.
+ */
+#define SHARED_BENCH(operation, map, key, maxSize) \
+    BENCHMARK_TEMPLATE(operation, map<key>, key)->RangeMultiplier(SIZE_MULTIPLIER) \
+            ->Range(MIN_SIZE, maxSize)->ThreadRange(1, MAX_THREADS)->UseRealTime()
+
+/**
+ * Register all the operations on one map type and key type.
+ */
+#define HASHMAP_BENCH_ALL(map, key) \
+    HASHMAP_BENCH(benchInsert, map, key); \
+    HASHMAP_BENCH(benchLookupHit, map, key); \
+    HASHMAP_BENCH(benchLookupMiss, map, key); \
+    HASHMAP_BENCH(benchErase, map, key); \
+    HASHMAP_BENCH(benchIterate, map, key); \
+    HASHMAP_BENCH(benchRehash, map, key)
+
+HASHMAP_BENCH_ALL(StdMap, IntKey);
+HASHMAP_BENCH_ALL(ChainedMap, IntKey);
+HASHMAP_BENCH_ALL(FlatMap, IntKey);
+HASHMAP_BENCH_ALL(OrderedMap, IntKey);
+HASHMAP_BENCH_ALL(IncrementalMap, IntKey);
+HASHMAP_BENCH_ALL(SmallMap, IntKey);
+
+HASHMAP_BENCH_ALL(StdMap, string);
+HASHMAP_BENCH_ALL(ChainedMap, string);
+HASHMAP_BENCH_ALL(FlatMap, string);
+HASHMAP_BENCH_ALL(CachedFlatMap, string);
+HASHMAP_BENCH_ALL(OrderedMap, string);
+
+// StringHashMap keys are always strings, and it has no rehash to a smaller table.
+BENCHMARK_TEMPLATE(benchInsert, StringMap, string)->RangeMultiplier(SIZE_MULTIPLIER)
+        ->Range(MIN_SIZE, MAX_SIZE);
+BENCHMARK_TEMPLATE(benchLookupHit, StringMap, string)->RangeMultiplier(SIZE_MULTIPLIER)
+        ->Range(MIN_SIZE, MAX_SIZE);
+BENCHMARK_TEMPLATE(benchLookupMiss, StringMap, string)->RangeMultiplier(SIZE_MULTIPLIER)
+        ->Range(MIN_SIZE, MAX_SIZE);
+BENCHMARK_TEMPLATE(benchErase, StringMap, string)->RangeMultiplier(SIZE_MULTIPLIER)
+        ->Range(MIN_SIZE, MAX_SIZE);
+BENCHMARK_TEMPLATE(benchIterate, StringMap, string)->RangeMultiplier(SIZE_MULTIPLIER)
+        ->Range(MIN_SIZE, MAX_SIZE);
+
+// FrozenHashMap is built once, and only searched and iterated.
+HASHMAP_BENCH(benchLookupHit, FrozenMap, IntKey);
+HASHMAP_BENCH(benchLookupMiss, FrozenMap, IntKey);
+HASHMAP_BENCH(benchIterate, FrozenMap, IntKey);
+HASHMAP_BENCH(benchLookupHit, FrozenMap, string);
+HASHMAP_BENCH(benchLookupMiss, FrozenMap, string);
+HASHMAP_BENCH(benchIterate, FrozenMap, string);
+
+SHARED_BENCH(benchSharedLookup, ConcurrentMap, IntKey, MAX_SIZE);
+SHARED_BENCH(benchSharedUpdate, ConcurrentMap, IntKey, MAX_UPDATE_SIZE);
+SHARED_BENCH(benchSharedLookup, RcuMap, IntKey, MAX_SIZE);
+SHARED_BENCH(benchSharedUpdate, RcuMap, IntKey, MAX_UPDATE_SIZE);
+SHARED_BENCH(benchSharedLookup, ConcurrentMap, string, MAX_SIZE);
+SHARED_BENCH(benchSharedLookup, RcuMap, string, MAX_SIZE);
+
+BENCHMARK_MAIN();
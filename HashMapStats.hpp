@@ -0,0 +1,184 @@
+/**
+ * @file HashMapStats.hpp
+ * @author Aviad Dudkevich
+ * @brief Statistics of a hash table - the lengths of its buckets, and, if compiled with
+ * HASHMAP_STATS, counters of its lookups and rehashes - to tune load factors and find bad hash
+ * functions.
+ */
+#ifndef HASHMAP_STATS_HPP
+#define HASHMAP_STATS_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <ostream>
+#include <vector>
+
+// Constants
+// bucket lengths from this one on are counted together in the histogram.
+const std::size_t STATS_HISTOGRAM_SIZE = 16;
+
+/**
+ * HashMapStats struct - a snapshot of the statistics of a table. A bucket is the pairs a lookup
+ * may have to pass: a chain of ChainedStorage, and the pairs with the same home slot in the open
+ * addressing engines.
+ */
+struct HashMapStats
+{
+    long size, capacity;
+    std::vector<long> bucketLengths; // the number of buckets of every length, from 0.
+    long maxBucketLength;
+    bool counted; // true if compiled with HASHMAP_STATS - the counters below are 0 otherwise.
+    long hits, misses; // searches that found their key and that didn't.
+    long rehashes;
+    double rehashSeconds; // the total time of the rehashes.
+
+    /**
+     * Count the buckets of the given table.
+     * @tparam Table a storage engine, like ChainedTable.
+     * @param table the table.
+     * @return statistics of the table, without the counters.
+     */
+    template<typename Table>
+    static HashMapStats of(const Table &table)
+    {
+        HashMapStats result{table.size(), table.capacity(),
+                            std::vector<long>(STATS_HISTOGRAM_SIZE, 0), 0, false, 0, 0, 0, 0};
+        std::vector<long> pairs; // the number of pairs in buckets of every length.
+        for (auto position = table.begin(); position != table.end();
+             position = table.next(position))
+        {
+            const long length = table.bucketSize(table.hashAt(position));
+            if (length >= (long) pairs.size())
+            {
+                pairs.resize((std::size_t) length + 1, 0);
+            }
+            ++pairs[length];
+        }
+        long buckets = 0; // the buckets that are not empty.
+        for (long length = 1; length < (long) pairs.size(); ++length)
+        {
+            if (pairs[length] != 0)
+            {
+                result.addBuckets(length, pairs[length] / length);
+                buckets += pairs[length] / length;
+            }
+        }
+        result.addBuckets(0, result.capacity - buckets);
+        return result;
+    }
+
+    /**
+     * Add buckets of one length to the histogram.
+     * @param length the length of the buckets.
+     * @param count the number of buckets.
+     */
+    void addBuckets(const long &length, const long &count)
+    {
+        const std::size_t bin = (std::size_t) length < STATS_HISTOGRAM_SIZE ?
+                                (std::size_t) length : STATS_HISTOGRAM_SIZE - 1;
+        bucketLengths[bin] += count;
+        if (count != 0 && length > maxBucketLength)
+        {
+            maxBucketLength = length;
+        }
+    }
+
+    /**
+     * Print the statistics, one subject in a line.
+     * @param out the stream to print to.
+     */
+    void print(std::ostream &out) const
+    {
+        out << "size " << size << ", capacity " << capacity << ", load factor "
+            << (capacity == 0 ? 0 : (double) size / capacity) << "\n";
+        out << "bucket lengths:";
+        for (std::size_t length = 0; length < bucketLengths.size(); ++length)
+        {
+            if (bucketLengths[length] != 0)
+            {
+                out << " " << length << (length == STATS_HISTOGRAM_SIZE - 1 ? "+" : "") << ": "
+                    << bucketLengths[length];
+            }
+        }
+        out << "\nmax bucket length " << maxBucketLength << "\n";
+        if (!counted)
+        {
+            out << "searches and rehashes are not counted - HASHMAP_STATS counts them\n";
+            return;
+        }
+        out << "searches " << hits + misses << ", hits " << hits << ", misses " << misses << "\n";
+        out << "rehashes " << rehashes << ", " << rehashSeconds << " seconds\n";
+    }
+};
+
+/**
+ * StatsCounters class - the counters of a table's searches and rehashes, kept only if compiled
+ * with HASHMAP_STATS. They are atomic, so the concurrent readers of a const table can count, and
+ * relaxed - a count is exact once the readers are done. A copy of a table starts from 0.
+ */
+class StatsCounters
+{
+public:
+    StatsCounters() = default;
+
+    /**
+     * Copy constructor - the counters of the copy start from 0.
+     * @param other the counters of the table that is copied.
+     */
+    StatsCounters(const StatsCounters &other)
+    { (void) other; }
+
+    /**
+     * Assignment operator - the counters are of this object, so they are kept.
+     * @param other the counters of the table that is assigned.
+     * @return a reference to this.
+     */
+    StatsCounters &operator=(const StatsCounters &other)
+    {
+        (void) other;
+        return *this;
+    }
+
+    /**
+     * Count a search.
+     * @param found true if it found its key.
+     */
+    inline void search(const bool &found) const
+    { (found ? _hits : _misses).fetch_add(1, std::memory_order_relaxed); }
+
+    /**
+     * Time and count a rehash.
+     * @tparam Function callable with no arguments.
+     * @param rehash the rehash.
+     */
+    template<typename Function>
+    void rehash(const Function &rehash)
+    {
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        rehash();
+        _rehashNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count();
+        ++_rehashes;
+    }
+
+    /**
+     * Add the counters to statistics.
+     * @param stats the statistics of the table.
+     */
+    void addTo(HashMapStats &stats) const
+    {
+        stats.counted = true;
+        stats.hits = _hits.load(std::memory_order_relaxed);
+        stats.misses = _misses.load(std::memory_order_relaxed);
+        stats.rehashes = _rehashes;
+        stats.rehashSeconds = (double) _rehashNanoseconds / 1e9;
+    }
+
+private:
+    mutable std::atomic<long> _hits{0}, _misses{0};
+    long _rehashes = 0; // rehashes happen only in non const functions, that writers don't share.
+    long long _rehashNanoseconds = 0;
+};
+
+#endif //HASHMAP_STATS_HPP
@@ -0,0 +1,92 @@
+/**
+ * @file HashedEntry.hpp
+ * @author Aviad Dudkevich
+ * @brief An element of a HashMap storage engine - a pair, and optionally the hash of its key.
+ */
+#ifndef HASHED_ENTRY_HPP
+#define HASHED_ENTRY_HPP
+
+#include <cstddef>
+#include <utility>
+
+/**
+ * HashedEntry struct - a pair kept in a storage engine, without its hash value. The hash is
+ * computed again whenever the engine needs it (rehash).
+ * @tparam T the pair type.
+ * @tparam CacheHash true to keep the full hash value of the key next to the pair.
+ */
+template<typename T, bool CacheHash>
+struct HashedEntry
+{
+    T value;
+
+    /**
+     * Constructor given the hash value of the key and the pair constructor arguments.
+     * @param hash ignored.
+     * @param args arguments for the pair constructor.
+     */
+    template<typename... Args>
+    explicit HashedEntry(const std::size_t &hash, Args &&... args) :
+            value(std::forward<Args>(args)...)
+    { (void) hash; }
+
+    /**
+     * @param hasher hash function object of the key.
+     * @return the hash value of the key.
+     */
+    template<typename Hash>
+    inline std::size_t hash(const Hash &hasher) const
+    { return hasher(value.first); }
+
+    /**
+     * @param hash hash value of a key.
+     * @return always true - without the hash value there is nothing to reject by.
+     */
+    inline bool hashMatches(const std::size_t &hash) const
+    {
+        (void) hash;
+        return true;
+    }
+};
+
+/**
+ * HashedEntry struct - a pair kept in a storage engine, with the full hash value of its key, so
+ * rehash never calls the hash function, and lookups compare keys only if their hashes are equal.
+ * @tparam T the pair type.
+ */
+template<typename T>
+struct HashedEntry<T, true>
+{
+    T value;
+    std::size_t cachedHash;
+
+    /**
+     * Constructor given the hash value of the key and the pair constructor arguments.
+     * @param hash the hash value of the key of the pair.
+     * @param args arguments for the pair constructor.
+     */
+    template<typename... Args>
+    explicit HashedEntry(const std::size_t &hash, Args &&... args) :
+            value(std::forward<Args>(args)...), cachedHash(hash)
+    {}
+
+    /**
+     * @param hasher ignored.
+     * @return the cached hash value of the key.
+     */
+    template<typename Hash>
+    inline std::size_t hash(const Hash &hasher) const
+    {
+        (void) hasher;
+        return cachedHash;
+    }
+
+    /**
+     * @param hash hash value of a key.
+     * @return true if it is the cached hash value - only then the keys can be equal.
+     */
+    inline bool hashMatches(const std::size_t &hash) const
+    { return cachedHash == hash; }
+};
+
+#endif //HASHED_ENTRY_HPP
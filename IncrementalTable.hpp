@@ -0,0 +1,368 @@
+/**
+ * @file IncrementalTable.hpp
+ * @author Aviad Dudkevich
+ * @brief Storage engine for HashMap that resizes incrementally - any other engine is kept twice,
+ * the old capacity and the new one, and the pairs move between them a few at a time.
+ */
+#ifndef INCREMENTAL_TABLE_HPP
+#define INCREMENTAL_TABLE_HPP
+
+#include <utility>
+#include "FlatTable.hpp"
+
+/**
+ * IncrementalTable class - hash table storage that never moves all its pairs at once. rehash()
+ * only allocates a new table and keeps the old one; after that every emplace and erase moves
+ * MIGRATION_STEP pairs from the old table to the new one, until the old one is empty and freed.
+ * New pairs are added to the new table only, and lookups search both tables while a resize is
+ * in progress. With the HashMap load factors every resize ends long before the next one starts,
+ * so the worst case insert and erase time doesn't grow with the size of the table - it is only
+ * the allocation of the new table.
+ * @tparam Inner storage engine of a single table, like ChainedTable or FlatTable.
+ */
+template<typename Inner>
+class IncrementalTable
+{
+    typedef typename Inner::Position InnerPosition;
+
+public:
+    typedef typename Inner::value_type value_type;
+    typedef typename Inner::allocator_type allocator_type;
+
+    /**
+     * Position of an element - the table it is in, and the position in that table.
+     */
+    struct Position
+    {
+        bool old;
+        InnerPosition position;
+
+        inline bool operator==(const Position &other) const
+        { return old == other.old && position == other.position; }
+
+        inline bool operator!=(const Position &other) const
+        { return !(*this == other); }
+    };
+
+    /**
+     * Constructor given the capacity.
+     * @param capacity long, must be a power of 2.
+     * @param allocator the allocator of both tables.
+     */
+    explicit IncrementalTable(const long &capacity,
+                              const allocator_type &allocator = allocator_type()) :
+            _new(capacity, allocator), _old(0, allocator), _cursor(_old.end())
+    {}
+
+    /**
+     * Copy constructor - copy both tables and the progress of the resize.
+     * @param other another IncrementalTable.
+     */
+    IncrementalTable(const IncrementalTable &other) :
+            _new(other._new),
+            _old(other._isResizing() ? other._old : Inner(0, _new.get_allocator())),
+            _cursor(other._cursor)
+    {}
+
+    /**
+     * Move constructor. The other table is left without slots.
+     * @param other rvalue reference to IncrementalTable.
+     */
+    IncrementalTable(IncrementalTable &&other) noexcept : _new(std::move(other._new)),
+                                                          _old(std::move(other._old)),
+                                                          _cursor(other._cursor)
+    {}
+
+    IncrementalTable &operator=(const IncrementalTable &other) = delete;
+
+    /**
+     * @return the capacity the table is resizing to, or its capacity if it is not resizing.
+     */
+    inline long capacity() const
+    { return _new.capacity(); }
+
+    /**
+     * @return the allocator of the tables.
+     */
+    inline allocator_type get_allocator() const
+    { return _new.get_allocator(); }
+
+    /**
+     * @return the number of pairs in both tables.
+     */
+    inline long size() const
+    { return _new.size() + _old.size(); }
+
+    /**
+     * @param key KeyT value, or a key-like value if Hash is transparent.
+     * @return the hash value of the key.
+     */
+    template<typename K>
+    inline static std::size_t hashOf(const K &key)
+    { return Inner::hashOf(key); }
+
+    /**
+     * Search for the pair with the given key, in the new table and then in the old one.
+     * @param key KeyT value, or a key-like value comparable to KeyT with KeyEqual.
+     * @param hash the hash value of key.
+     * @return position of the pair, or end() if there is no pair with that key.
+     */
+    template<typename K>
+    Position find(const K &key, const std::size_t &hash) const
+    {
+        const InnerPosition position = _new.find(key, hash);
+        if (position == _new.end() && _isResizing())
+        {
+            const InnerPosition oldPosition = _old.find(key, hash);
+            if (oldPosition != _old.end())
+            {
+                return Position{true, oldPosition};
+            }
+        }
+        return Position{false, position};
+    }
+
+    /**
+     * Start loading what a lookup of the given hash value reads first, in the new table and,
+     * during a resize, in the old one.
+     * @param hash hash value of a key.
+     */
+    inline void prefetch(const std::size_t &hash) const
+    {
+        _new.prefetch(hash);
+        if (_isResizing())
+        {
+            _old.prefetch(hash);
+        }
+    }
+
+    /**
+     * Search for the pair with the given key, and if it is missing - where to add it.
+     * @param key KeyT value, or a key-like value comparable to KeyT with KeyEqual.
+     * @param hash the hash value of key.
+     * @return the position of the pair and true, or the position for emplaceAt() in the new
+     * table and false if there is no pair with that key.
+     */
+    template<typename K>
+    std::pair<Position, bool> findOrPrepareInsert(const K &key, const std::size_t &hash) const
+    {
+        const std::pair<InnerPosition, bool> found = _new.findOrPrepareInsert(key, hash);
+        if (!found.second && _isResizing())
+        {
+            const InnerPosition oldPosition = _old.find(key, hash);
+            if (oldPosition != _old.end())
+            {
+                return {Position{true, oldPosition}, true};
+            }
+        }
+        return {Position{false, found.first}, found.second};
+    }
+
+    /**
+     * Construct a new pair in the table. Assumption: there is no pair with the same key.
+     * @param hash the hash value of the key of the new pair.
+     * @param args arguments for the pair constructor.
+     * @return position of the new pair.
+     */
+    template<typename... Args>
+    inline Position emplace(const std::size_t &hash, Args &&... args)
+    { return emplaceAt(end(), hash, std::forward<Args>(args)...); }
+
+    /**
+     * Construct a new pair in the new table, in the position returned by findOrPrepareInsert().
+     * During a resize, MIGRATION_STEP pairs are moved first, so the position is not used and the
+     * new table is searched again.
+     * @param position position returned by findOrPrepareInsert(), or end().
+     * @param hash the hash value of the key of the new pair.
+     * @param args arguments for the pair constructor.
+     * @return position of the new pair.
+     */
+    template<typename... Args>
+    Position emplaceAt(const Position &position, const std::size_t &hash, Args &&... args)
+    {
+        if (!_isResizing())
+        {
+            return Position{false, _new.emplaceAt(position.position, hash,
+                                                  std::forward<Args>(args)...)};
+        }
+        _migrate();
+        return Position{false, _new.emplace(hash, std::forward<Args>(args)...)};
+    }
+
+    /**
+     * Remove the pair in the given position, then move MIGRATION_STEP pairs if there is a resize
+     * in progress.
+     * @param position position of existing pair.
+     */
+    void erase(const Position &position)
+    {
+        if (!position.old)
+        {
+            _new.erase(position.position);
+        }
+        else if (position.position == _cursor)
+        {
+            _cursor = _old.erase(position.position);
+        }
+        else
+        {
+            _old.erase(position.position);
+        }
+        _migrate();
+    }
+
+    /**
+     * @param position position of existing pair.
+     * @return reference to the pair.
+     */
+    inline value_type &get(const Position &position)
+    { return position.old ? _old.get(position.position) : _new.get(position.position); }
+
+    /**
+     * @param position position of existing pair.
+     * @return const reference to the pair.
+     */
+    inline const value_type &get(const Position &position) const
+    { return position.old ? _old.get(position.position) : _new.get(position.position); }
+
+    /**
+     * @param position position of existing pair.
+     * @return the hash value of the key of the pair.
+     */
+    inline std::size_t hashAt(const Position &position) const
+    { return position.old ? _old.hashAt(position.position) : _new.hashAt(position.position); }
+
+    /**
+     * @return position of the first pair, or end() if the table is empty. The pairs left in the
+     * old table come first.
+     */
+    inline Position begin() const
+    { return _isResizing() ? Position{true, _cursor} : Position{false, _new.begin()}; }
+
+    /**
+     * @param position position of existing pair.
+     * @return position of the pair after it, or end() if it is the last one.
+     */
+    Position next(const Position &position) const
+    {
+        if (!position.old)
+        {
+            return Position{false, _new.next(position.position)};
+        }
+        const InnerPosition oldNext = _old.next(position.position);
+        return oldNext != _old.end() ? Position{true, oldNext} : Position{false, _new.begin()};
+    }
+
+    /**
+     * @return position after the last pair.
+     */
+    inline Position end() const
+    { return Position{false, _new.end()}; }
+
+    /**
+     * @param hash hash value of a key.
+     * @return the number of pairs in the bucket of that hash, in both tables.
+     */
+    inline long bucketSize(const std::size_t &hash) const
+    { return _new.bucketSize(hash) + (_isResizing() ? _old.bucketSize(hash) : 0); }
+
+    /**
+     * Erase all pairs, keep the capacity the table is resizing to.
+     */
+    void clear()
+    {
+        _new.clear();
+        _dropOld();
+    }
+
+    /**
+     * Start a resize to the given capacity. A resize that is still in progress is finished first,
+     * and an empty table is resized at once.
+     * @param newCapacity the capacity of the new table, must be a power of 2.
+     */
+    void rehash(const long &newCapacity)
+    {
+        while (_isResizing())
+        {
+            _migrate();
+        }
+        Inner table(newCapacity, _new.get_allocator());
+        if (_new.size() != 0)
+        {
+            swap(_old, _new);
+            _cursor = _old.begin();
+        }
+        swap(_new, table);
+    }
+
+    /**
+     * Aid swap of HashMap.
+     * @param first IncrementalTable reference.
+     * @param second IncrementalTable reference.
+     */
+    friend void swap(IncrementalTable &first, IncrementalTable &second) noexcept
+    {
+        using std::swap;
+        swap(first._new, second._new);
+        swap(first._old, second._old);
+        swap(first._cursor, second._cursor);
+    }
+
+private:
+    // how many pairs move to the new table in every emplace and erase during a resize. It must
+    // be at least 2, so a resize ends before the load factors can start another one.
+    static const int MIGRATION_STEP = 4;
+
+    Inner _new; // the table in the current capacity - all new pairs are added to it.
+    Inner _old; // the table before the resize, without slots if there is no resize.
+    InnerPosition _cursor; // the first pair in the old table - all the pairs before it moved.
+
+    /**
+     * @return true if there are pairs left in the old table.
+     */
+    inline bool _isResizing() const
+    { return _old.size() != 0; }
+
+    /**
+     * Move up to MIGRATION_STEP pairs from the old table to the new one, and free the old table
+     * once it is empty. A pair is copied instead only if its move constructor may throw, and it
+     * is erased from the old table only after it is in the new one.
+     */
+    void _migrate()
+    {
+        for (int i = 0; i < MIGRATION_STEP && _isResizing(); ++i)
+        {
+            _new.emplace(_old.hashAt(_cursor), std::move_if_noexcept(_old.get(_cursor)));
+            _cursor = _old.erase(_cursor);
+        }
+        if (!_isResizing())
+        {
+            _dropOld();
+        }
+    }
+
+    /**
+     * Free the old table.
+     */
+    void _dropOld()
+    {
+        Inner dropped(std::move(_old));
+        _cursor = _old.end();
+    }
+};
+
+/**
+ * Storage policy for HashMap - another storage policy, resized incrementally. FlatStorage is the
+ * default since a new flat table is allocated without touching its slots; a new chained table
+ * constructs all its buckets, which takes time in proportion to its capacity.
+ * @tparam Storage the storage policy of a single table.
+ */
+template<typename Storage = FlatStorage>
+struct IncrementalStorage
+{
+    template<typename KeyT, typename ValueT, typename Hash, typename KeyEqual, typename Allocator>
+    using Table = IncrementalTable<typename Storage::template Table<KeyT, ValueT, Hash, KeyEqual,
+            Allocator>>;
+};
+
+#endif //INCREMENTAL_TABLE_HPP
@@ -0,0 +1,158 @@
+/**
+ * @file MappedFile.hpp
+ * @author Aviad Dudkevich
+ * @brief Read-only view of a whole file - memory mapped when the file is a regular one, and read
+ * into a buffer when it is a pipe, a terminal or the standard input.
+ */
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Constants
+static const char *STANDARD_INPUT_PATH = "-";
+const std::size_t READ_CHUNK_SIZE = 64 * 1024;
+
+/**
+ * MappedFile class - the content of a file as a contiguous read-only buffer, without copying it
+ * when possible. A regular file is mapped to memory and the pages are read by the system on first
+ * access; anything that can't be mapped (a pipe, a terminal) is read to the end into a buffer.
+ * The path "-" is the standard input.
+ * Like std::ifstream, the constructor doesn't fail - good() tells if the file was read.
+ */
+class MappedFile
+{
+public:
+    /**
+     * Constructor given a path. Can throw bad_alloc if the file is read into a buffer.
+     * @param path the path of the file, or "-" for the standard input.
+     */
+    explicit MappedFile(const char *path) : _data(nullptr), _size(0), _mapped(false), _good(false)
+    {
+        const bool standardInput = std::strcmp(path, STANDARD_INPUT_PATH) == 0;
+        const int descriptor = standardInput ? STDIN_FILENO : ::open(path, O_RDONLY);
+        if (descriptor < 0)
+        {
+            return;
+        }
+        struct stat status{};
+        if (::fstat(descriptor, &status) == 0 && S_ISREG(status.st_mode) && status.st_size > 0)
+        {
+            _map(descriptor, (std::size_t) status.st_size);
+        }
+        if (!_mapped)
+        {
+            _read(descriptor);
+        }
+        if (!standardInput)
+        {
+            ::close(descriptor);
+        }
+    }
+
+    MappedFile(const MappedFile &other) = delete;
+
+    MappedFile &operator=(const MappedFile &other) = delete;
+
+    /**
+     * Destructor - unmap the file.
+     */
+    ~MappedFile()
+    {
+        if (_mapped)
+        {
+            ::munmap(const_cast<char *>(_data), _size);
+        }
+    }
+
+    /**
+     * @param path the path of a file.
+     * @return true if the file is a regular one, so MappedFile would map it.
+     */
+    static bool mappable(const char *path)
+    {
+        struct stat status{};
+        return std::strcmp(path, STANDARD_INPUT_PATH) != 0 && ::stat(path, &status) == 0 &&
+               S_ISREG(status.st_mode);
+    }
+
+    /**
+     * @return true if the file was opened and read to the end.
+     */
+    inline bool good() const
+    { return _good; }
+
+    /**
+     * @return true if the content is mapped to memory, false if it was read into a buffer.
+     */
+    inline bool mapped() const
+    { return _mapped; }
+
+    /**
+     * @return the content of the file - valid as long as the MappedFile is.
+     */
+    inline std::string_view view() const
+    { return std::string_view(_data, _size); }
+
+private:
+    const char *_data; // the content - the mapping, or the buffer.
+    std::size_t _size; // the number of bytes of the content.
+    bool _mapped; // true if _data is a mapping.
+    bool _good; // true if the whole file was read.
+    std::string _buffer; // the content of a file that can't be mapped.
+
+    /**
+     * Map a regular file. On failure nothing changes, so the file can still be read.
+     * @param descriptor open file descriptor.
+     * @param size the size of the file.
+     */
+    void _map(const int &descriptor, const std::size_t &size)
+    {
+        void *address = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+        if (address == MAP_FAILED)
+        {
+            return;
+        }
+        ::madvise(address, size, MADV_SEQUENTIAL); // a hint only, the result doesn't matter.
+        _data = static_cast<const char *>(address);
+        _size = size;
+        _mapped = _good = true;
+    }
+
+    /**
+     * Read a file to the end into _buffer. Can throw bad_alloc.
+     * @param descriptor open file descriptor.
+     */
+    void _read(const int &descriptor)
+    {
+        std::size_t used = 0;
+        while (true)
+        {
+            _buffer.resize(used + READ_CHUNK_SIZE);
+            const ssize_t count = ::read(descriptor, &_buffer[used], READ_CHUNK_SIZE);
+            if (count < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (count <= 0)
+            {
+                _good = count == 0;
+                break;
+            }
+            used += (std::size_t) count;
+        }
+        _buffer.resize(used);
+        _data = _buffer.data();
+        _size = used;
+    }
+};
+
+#endif //MAPPED_FILE_HPP
@@ -0,0 +1,118 @@
+/**
+ * @file MessageStream.hpp
+ * @author Aviad Dudkevich
+ * @brief Stream buffer that splits an input stream into messages separated by a delimiter byte,
+ * so every message can be read like a stream of its own.
+ */
+#ifndef MESSAGE_STREAM_HPP
+#define MESSAGE_STREAM_HPP
+
+#include <cstddef>
+#include <cstring>
+#include <istream>
+#include <streambuf>
+#include <vector>
+
+// Constants
+const std::size_t MESSAGE_STREAM_BUFFER_SIZE = 64 * 1024;
+
+/**
+ * MessageStream class - stream buffer over the messages of a source stream. next() moves to the
+ * next message, and reading from the buffer (through an std::istream) gives the bytes of the
+ * current message only - it ends at the delimiter, that is not part of any message. A message
+ * that is not read to its end is skipped by next(). An empty source has no messages, and a
+ * delimiter at the end of the source doesn't start another one.
+ */
+class MessageStream : public std::streambuf
+{
+public:
+    /**
+     * Constructor given a source stream.
+     * @param source the stream to read the messages from - it must outlive the MessageStream.
+     * @param delimiter the byte between messages.
+     */
+    MessageStream(std::istream &source, const char &delimiter) :
+            _source(source), _delimiter(delimiter), _buffer(MESSAGE_STREAM_BUFFER_SIZE),
+            _end(_buffer.data()), _delimited(false), _started(false), _inMessage(false)
+    { setg(_buffer.data(), _buffer.data(), _buffer.data()); }
+
+    MessageStream(const MessageStream &other) = delete;
+
+    MessageStream &operator=(const MessageStream &other) = delete;
+
+    /**
+     * Move to the next message - the first one on the first call.
+     * @return true if there is a next message, false if the source ended.
+     */
+    bool next()
+    {
+        if (_inMessage)
+        {
+            while (underflow() != traits_type::eof()) // skip the rest of the message.
+            {
+                setg(eback(), egptr(), egptr());
+            }
+            if (!_delimited)
+            {
+                _inMessage = false;
+                return false;
+            }
+            _setMessage(egptr() + 1);
+        }
+        else if (_started)
+        {
+            return false;
+        }
+        _started = true;
+        _inMessage = gptr() != _end || _fill();
+        return _inMessage;
+    }
+
+protected:
+    /**
+     * @return the next byte of the current message, or eof at its end.
+     */
+    int_type underflow() override
+    {
+        if (gptr() == egptr() && _inMessage && !_delimited)
+        {
+            _fill();
+        }
+        return gptr() < egptr() ? traits_type::to_int_type(*gptr()) : traits_type::eof();
+    }
+
+private:
+    std::istream &_source; // the stream of the messages.
+    const char _delimiter; // the byte between messages.
+    std::vector<char> _buffer; // bytes read from _source.
+    char *_end; // the end of the bytes read into _buffer.
+    bool _delimited; // true if the current message ends at egptr(), in _buffer.
+    bool _started; // true since the first call to next().
+    bool _inMessage; // true from next() that found a message until the next one that didn't.
+
+    /**
+     * Make the get area the part of the current message from a position in _buffer on - up to
+     * the next delimiter, or the end of the bytes read.
+     * @param begin a position in _buffer, at most _end.
+     */
+    void _setMessage(char *begin)
+    {
+        char *delimiter = static_cast<char *>(std::memchr(begin, _delimiter, _end - begin));
+        _delimited = delimiter != nullptr;
+        setg(_buffer.data(), begin, _delimited ? delimiter : _end);
+    }
+
+    /**
+     * Replace the bytes of _buffer with the next bytes of the source.
+     * @return true if any bytes were read, false if the source ended.
+     */
+    bool _fill()
+    {
+        _source.read(_buffer.data(), (std::streamsize) _buffer.size());
+        _end = _buffer.data() + _source.gcount();
+        _setMessage(_buffer.data());
+        return _end != _buffer.data();
+    }
+};
+
+#endif //MESSAGE_STREAM_HPP
@@ -0,0 +1,402 @@
+/**
+ * @file OrderedTable.hpp
+ * @author Aviad Dudkevich
+ * @brief Insertion ordered storage engine for HashMap - the pairs are kept densely in the order
+ * they were added, and a separate table of small indices finds them (Python's compact dict).
+ */
+#ifndef ORDERED_TABLE_HPP
+#define ORDERED_TABLE_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+#include "Prefetch.hpp"
+
+/**
+ * OrderedTable class - hash table storage with two arrays. The entries array keeps the pairs, with
+ * the hash value of their keys, in the order they were added; the index array has a slot for
+ * every bucket with the position of an entry, EMPTY, or DELETED, and is probed linearly. The
+ * index slots are 4 bytes, so the table is small even when the pairs are big, iteration is a
+ * scan of the entries in insertion order - the same order on every run - and copying the table
+ * copies two arrays.
+ * Erase leaves a hole in the entries and a tombstone in the index, so the positions of the other
+ * pairs and their order don't change. Holes and tombstones are dropped by rehash(), and when they
+ * fill the index - so iteration after many erases costs the erased pairs too, until then.
+ * The table never changes its own capacity unless asked to by rehash() - keeping the load factor
+ * is the HashMap responsibility.
+ * @tparam KeyT type argument for generic key.
+ * @tparam ValueT type argument for generic value.
+ * @tparam Hash hash function object for KeyT.
+ * @tparam KeyEqual function object that compares two keys.
+ * @tparam Allocator allocator of pairs - the entries and the index are allocated by it.
+ */
+template<typename KeyT, typename ValueT, typename Hash, typename KeyEqual, typename Allocator>
+class OrderedTable
+{
+public:
+    typedef std::pair<KeyT, ValueT> value_type;
+    typedef Allocator allocator_type;
+    typedef long Position;
+
+    /**
+     * Constructor given the number of index slots.
+     * @param capacity long, must be a power of 2.
+     * @param allocator the allocator of the table.
+     */
+    explicit OrderedTable(const long &capacity, const Allocator &allocator = Allocator()) :
+            _entries(EntryAllocator(allocator)),
+            _index((std::size_t) capacity, EMPTY, IndexAllocator(allocator)), _size(0)
+    {}
+
+    /**
+     * @return the number of index slots.
+     */
+    inline long capacity() const
+    { return (long) _index.size(); }
+
+    /**
+     * @return the allocator of the table.
+     */
+    inline Allocator get_allocator() const
+    { return Allocator(_entries.get_allocator()); }
+
+    /**
+     * @return the number of pairs in the table.
+     */
+    inline long size() const
+    { return _size; }
+
+    /**
+     * @param key KeyT value, or a key-like value if Hash is transparent.
+     * @return the hash value of the key.
+     */
+    template<typename K>
+    inline static std::size_t hashOf(const K &key)
+    { return Hash{}(key); }
+
+    /**
+     * Search for the pair with the given key.
+     * @param key KeyT value, or a key-like value comparable to KeyT with KeyEqual.
+     * @param hash the hash value of key.
+     * @return position of the pair, or end() if there is no pair with that key.
+     */
+    template<typename K>
+    Position find(const K &key, const std::size_t &hash) const
+    {
+        if (_index.empty())
+        {
+            return end();
+        }
+        const std::size_t mask = _index.size() - 1;
+        std::size_t slot = _mix(hash) & mask;
+        // a full index has no EMPTY slot to end the probe, so it ends after a round.
+        for (std::size_t probes = 0; probes < _index.size() && _index[slot] != EMPTY;
+             ++probes, slot = (slot + 1) & mask)
+        {
+            const std::uint32_t entry = _index[slot];
+            if (entry != DELETED && _entries[entry].hash == hash &&
+                KeyEqual{}(_entries[entry].value->first, key))
+            {
+                return (Position) entry;
+            }
+        }
+        return end();
+    }
+
+    /**
+     * Start loading the first index slot of the given hash value. The entry it points to can't
+     * be loaded before the slot is read.
+     * @param hash hash value of a key.
+     */
+    inline void prefetch(const std::size_t &hash) const
+    {
+        if (!_index.empty())
+        {
+            prefetchRead(_index.data() + (_mix(hash) & (_index.size() - 1)));
+        }
+    }
+
+    /**
+     * Search for the pair with the given key, and if it is missing - where to add it. A new pair
+     * always goes to the end of the entries, so the position is end().
+     * @param key KeyT value, or a key-like value comparable to KeyT with KeyEqual.
+     * @param hash the hash value of key.
+     * @return the position of the pair and true, or end() and false if there is no pair with
+     * that key.
+     */
+    template<typename K>
+    std::pair<Position, bool> findOrPrepareInsert(const K &key, const std::size_t &hash) const
+    {
+        const Position position = find(key, hash);
+        return {position, position != end()};
+    }
+
+    /**
+     * Construct a new pair in the table. Assumption: there is no pair with the same key.
+     * @param hash the hash value of the key of the new pair.
+     * @param args arguments for the pair constructor.
+     * @return position of the new pair.
+     */
+    template<typename... Args>
+    inline Position emplace(const std::size_t &hash, Args &&... args)
+    { return emplaceAt(end(), hash, std::forward<Args>(args)...); }
+
+    /**
+     * Construct a new pair at the end of the entries. If holes and tombstones fill the index,
+     * they are dropped first - so at least one slot stays EMPTY, unless the pairs themselves fill
+     * the index.
+     * @param position ignored - the position returned by findOrPrepareInsert(), or end().
+     * @param hash the hash value of the key of the new pair.
+     * @param args arguments for the pair constructor.
+     * @return position of the new pair.
+     */
+    template<typename... Args>
+    Position emplaceAt(const Position &position, const std::size_t &hash, Args &&... args)
+    {
+        (void) position;
+        const std::size_t empty = std::max<std::size_t>(1, _index.size() / TOMBSTONES_FACTOR);
+        if (_size != (long) _entries.size() && _entries.size() + 1 + empty > _index.size())
+        {
+            rehash(capacity());
+        }
+        const std::uint32_t entry = (std::uint32_t) _entries.size();
+        _entries.push_back(Entry{hash, std::nullopt});
+        try
+        {
+            _entries.back().value.emplace(std::forward<Args>(args)...);
+        }
+        catch (...)
+        {
+            _entries.pop_back();
+            throw;
+        }
+        _index[_findFreeSlot(_index, hash)] = entry;
+        ++_size;
+        return (Position) entry;
+    }
+
+    /**
+     * Remove the pair in the given position - its entry becomes a hole, so no other pair moves.
+     * @param position position of existing pair.
+     * @return position of the pair after it in iteration order, or end() if it was the last one.
+     */
+    Position erase(const Position &position)
+    {
+        const std::size_t mask = _index.size() - 1;
+        std::size_t slot = _mix(_entries[position].hash) & mask;
+        while (_index[slot] != (std::uint32_t) position)
+        {
+            slot = (slot + 1) & mask;
+        }
+        _index[slot] = DELETED;
+        _entries[position].value.reset();
+        --_size;
+        return next(position);
+    }
+
+    /**
+     * @param position position of existing pair.
+     * @return reference to the pair.
+     */
+    inline value_type &get(const Position &position)
+    { return *_entries[position].value; }
+
+    /**
+     * @param position position of existing pair.
+     * @return const reference to the pair.
+     */
+    inline const value_type &get(const Position &position) const
+    { return *_entries[position].value; }
+
+    /**
+     * @param position position of existing pair.
+     * @return the hash value of the key of the pair.
+     */
+    inline std::size_t hashAt(const Position &position) const
+    { return _entries[position].hash; }
+
+    /**
+     * @return position of the first pair, or end() if the table is empty.
+     */
+    inline Position begin() const
+    { return _nextEntry(0); }
+
+    /**
+     * @param position position of existing pair.
+     * @return position of the pair after it, or end() if it is the last one.
+     */
+    inline Position next(const Position &position) const
+    { return _nextEntry(position + 1); }
+
+    /**
+     * @return position after the last pair.
+     */
+    inline Position end() const
+    { return (Position) _entries.size(); }
+
+    /**
+     * @param hash hash value of a key.
+     * @return the number of pairs with the same first index slot as that hash.
+     */
+    long bucketSize(const std::size_t &hash) const
+    {
+        if (_index.empty())
+        {
+            return 0;
+        }
+        const std::size_t mask = _index.size() - 1, home = _mix(hash) & mask;
+        long result = 0;
+        std::size_t slot = home;
+        for (std::size_t probes = 0; probes < _index.size() && _index[slot] != EMPTY;
+             ++probes, slot = (slot + 1) & mask)
+        {
+            const std::uint32_t entry = _index[slot];
+            if (entry != DELETED && (_mix(_entries[entry].hash) & mask) == home)
+            {
+                ++result;
+            }
+        }
+        return result;
+    }
+
+    /**
+     * Erase all pairs, keep the capacity.
+     */
+    void clear()
+    {
+        _entries.clear();
+        std::fill(_index.begin(), _index.end(), EMPTY);
+        _size = 0;
+    }
+
+    /**
+     * Build the index again with the given capacity, and drop the holes of erased pairs - the
+     * order of the pairs doesn't change. The pairs are copied instead only if their move
+     * constructor may throw, so a failed rehash leaves the table as it was.
+     * @param newCapacity the capacity of the new table, must be a power of 2 and bigger than
+     * size().
+     */
+    void rehash(const long &newCapacity)
+    {
+        std::vector<std::uint32_t, IndexAllocator> index((std::size_t) newCapacity, EMPTY,
+                                                         _index.get_allocator());
+        if (_size != (long) _entries.size())
+        {
+            std::vector<Entry, EntryAllocator> entries(_entries.get_allocator());
+            entries.reserve((std::size_t) _size);
+            for (Entry &entry: _entries)
+            {
+                if (entry.value.has_value())
+                {
+                    entries.push_back(std::move_if_noexcept(entry));
+                }
+            }
+            _entries.swap(entries);
+        }
+        for (std::size_t i = 0; i < _entries.size(); ++i)
+        {
+            index[_findFreeSlot(index, _entries[i].hash)] = (std::uint32_t) i;
+        }
+        _index.swap(index);
+    }
+
+    /**
+     * Aid swap of HashMap.
+     * @param first OrderedTable reference.
+     * @param second OrderedTable reference.
+     */
+    friend void swap(OrderedTable &first, OrderedTable &second) noexcept
+    {
+        using std::swap;
+        first._entries.swap(second._entries);
+        first._index.swap(second._index);
+        swap(first._size, second._size);
+    }
+
+private:
+    /**
+     * A pair and the hash value of its key - no pair in a hole.
+     */
+    struct Entry
+    {
+        std::size_t hash;
+        std::optional<value_type> value;
+    };
+
+    typedef typename std::allocator_traits<Allocator>::template rebind_alloc<Entry> EntryAllocator;
+    typedef typename std::allocator_traits<Allocator>::template rebind_alloc<std::uint32_t>
+            IndexAllocator;
+
+    // index slots that don't point to an entry.
+    static constexpr std::uint32_t EMPTY = ~(std::uint32_t) 0;
+    static constexpr std::uint32_t DELETED = EMPTY - 1;
+
+    // drop the holes when less than 1/TOMBSTONES_FACTOR of the index slots, and at least one,
+    // are empty.
+    static const std::size_t TOMBSTONES_FACTOR = 8;
+
+    std::vector<Entry, EntryAllocator> _entries; // the pairs in insertion order, and holes.
+    std::vector<std::uint32_t, IndexAllocator> _index; // the position of an entry, or EMPTY.
+    long _size; // the number of pairs - the entries that are not holes.
+
+    /**
+     * Scramble the hash value, so hash functions like the identity for integers still spread
+     * over the index.
+     * @param hash hash value of a key.
+     * @return mixed hash value.
+     */
+    inline static std::size_t _mix(const std::size_t &hash)
+    {
+        std::size_t mixed = hash * (std::size_t) 0x9E3779B97F4A7C15ULL;
+        return mixed ^ (mixed >> 32);
+    }
+
+    /**
+     * Assumption: the index has an EMPTY slot - emplaceAt() drops the tombstones before the
+     * last one is taken, and the HashMap never has more pairs than slots.
+     * @param index the index slots of a table.
+     * @param hash the hash value of a new key.
+     * @return the first empty slot on the probe sequence of that key. Tombstones are skipped, so
+     * a probe sequence never ends in the middle of the slots of another key.
+     */
+    static std::size_t _findFreeSlot(const std::vector<std::uint32_t, IndexAllocator> &index,
+                                     const std::size_t &hash)
+    {
+        const std::size_t mask = index.size() - 1;
+        std::size_t slot = _mix(hash) & mask;
+        while (index[slot] != EMPTY)
+        {
+            slot = (slot + 1) & mask;
+        }
+        return slot;
+    }
+
+    /**
+     * @param position the entry to start from.
+     * @return the first entry from the given one that is not a hole, or end().
+     */
+    Position _nextEntry(Position position) const
+    {
+        while (position < end() && !_entries[position].value.has_value())
+        {
+            ++position;
+        }
+        return position;
+    }
+};
+
+/**
+ * Storage policy for HashMap - the pairs in insertion order, with a separate index.
+ */
+struct OrderedStorage
+{
+    template<typename KeyT, typename ValueT, typename Hash, typename KeyEqual, typename Allocator>
+    using Table = OrderedTable<KeyT, ValueT, Hash, KeyEqual, Allocator>;
+};
+
+#endif //ORDERED_TABLE_HPP
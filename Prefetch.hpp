@@ -0,0 +1,34 @@
+/**
+ * @file Prefetch.hpp
+ * @author Aviad Dudkevich
+ * @brief Software prefetch, for lookups that know their addresses before they need the data.
+ */
+#ifndef PREFETCH_HPP
+#define PREFETCH_HPP
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <xmmintrin.h>
+#endif
+
+// Constants
+// how many lookups of a batch are between hashing a key and reading its slot - enough misses in
+// flight to cover the memory latency, few enough that the first lines are not evicted before use.
+const int PREFETCH_DISTANCE = 16;
+
+/**
+ * Ask the CPU to start loading the cache line of an address, without waiting for it. Only a hint -
+ * it does nothing where there is no prefetch instruction, and an invalid address doesn't fault.
+ * @param address the address that is about to be read.
+ */
+inline void prefetchRead(const void *address)
+{
+#if defined(__GNUC__)
+    __builtin_prefetch(address, 0, 3);
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    _mm_prefetch(static_cast<const char *>(address), _MM_HINT_T0);
+#else
+    (void) address;
+#endif
+}
+
+#endif //PREFETCH_HPP
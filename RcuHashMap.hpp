@@ -0,0 +1,398 @@
+/**
+ * @file RcuHashMap.hpp
+ * @author Aviad Dudkevich
+ * @brief Read-mostly HashMap - readers take no locks, writers build a new table and publish it
+ * atomically, and old tables are freed by epoch based reclamation.
+ */
+#ifndef RCU_HASHMAP_HPP
+#define RCU_HASHMAP_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "HashMap.hpp"
+
+// Constants
+const std::size_t DEFAULT_READER_SLOTS = 128;
+
+/**
+ * EpochDomain class - epoch based reclamation. A reader announces the global epoch in a slot
+ * while it reads, and a writer retires an object it unlinked with the epoch of the unlink. The
+ * object is freed once every reader is either out, or announced a later epoch - such a reader
+ * started after the unlink, so it can't see the object.
+ * The number of concurrent readers is bounded by the number of slots; a reader that finds no
+ * free slot waits for one.
+ */
+class EpochDomain
+{
+public:
+    /**
+     * Constructor given the number of reader slots.
+     * @param slots the number of readers that can be in at once.
+     */
+    explicit EpochDomain(const std::size_t &slots = DEFAULT_READER_SLOTS) :
+            _epoch(1), _slotCount(slots == 0 ? 1 : slots), _slots(new Slot[_slotCount])
+    {}
+
+    EpochDomain(const EpochDomain &other) = delete;
+
+    EpochDomain &operator=(const EpochDomain &other) = delete;
+
+    /**
+     * Destructor - free all the retired objects. No reader may be in.
+     */
+    ~EpochDomain()
+    {
+        for (Retired &retired: _retired)
+        {
+            retired.free();
+        }
+    }
+
+    /**
+     * Announce a reader - the objects it reads from now on are not freed until it leaves.
+     * @return the slot of the reader, for leave().
+     */
+    std::size_t enter()
+    {
+        const std::size_t start = std::hash<std::thread::id>{}(std::this_thread::get_id());
+        for (std::size_t i = 0;; ++i)
+        {
+            Slot &slot = _slots[(start + i) % _slotCount];
+            std::uint64_t idle = 0;
+            // seq_cst, so the load of the published object that follows can't move before it.
+            if (slot.epoch.load(std::memory_order_relaxed) == 0 &&
+                slot.epoch.compare_exchange_strong(idle, _epoch.load()))
+            {
+                return (start + i) % _slotCount;
+            }
+            if (i % _slotCount == _slotCount - 1)
+            {
+                std::this_thread::yield(); // all the slots are in use.
+            }
+        }
+    }
+
+    /**
+     * Leave - the reader doesn't use the objects it read anymore.
+     * @param slot the slot enter() returned.
+     */
+    inline void leave(const std::size_t &slot)
+    { _slots[slot].epoch.store(0, std::memory_order_release); }
+
+    /**
+     * Retire an object that was unlinked - no new reader can reach it - and free the retired
+     * objects that no reader can use anymore. Writers must not retire at once.
+     * @tparam T the type of the object.
+     * @param object pointer to the object, allocated by new.
+     */
+    template<typename T>
+    void retire(const T *object)
+    {
+        const std::uint64_t unlinked = _epoch.fetch_add(1);
+        _retired.push_back(Retired{object, unlinked, [](const void *pointer)
+        { delete static_cast<const T *>(pointer); }});
+        _retiredCount.store(_retired.size(), std::memory_order_relaxed);
+        collect();
+    }
+
+    /**
+     * Free the retired objects that no reader can use anymore. Writers must not collect at once.
+     */
+    void collect()
+    {
+        std::uint64_t oldest = _epoch.load(); // the oldest epoch a reader announced.
+        for (std::size_t i = 0; i < _slotCount; ++i)
+        {
+            const std::uint64_t epoch = _slots[i].epoch.load();
+            if (epoch != 0 && epoch < oldest)
+            {
+                oldest = epoch;
+            }
+        }
+        std::size_t kept = 0;
+        for (Retired &retired: _retired)
+        {
+            if (retired.unlinked < oldest)
+            {
+                retired.free();
+            }
+            else
+            {
+                _retired[kept++] = retired;
+            }
+        }
+        _retired.resize(kept);
+        _retiredCount.store(kept, std::memory_order_relaxed);
+    }
+
+    /**
+     * @return the number of retired objects that are not freed yet - may be called at any time,
+     * by readers too.
+     */
+    inline std::size_t retired() const
+    { return _retiredCount.load(std::memory_order_relaxed); }
+
+private:
+    /**
+     * The slot of a reader - the epoch it announced, or 0 if it is free. On a cache line of its
+     * own, so readers don't write to the same line.
+     */
+    struct alignas(64) Slot
+    {
+        std::atomic<std::uint64_t> epoch{0};
+    };
+
+    /**
+     * An object that waits to be freed.
+     */
+    struct Retired
+    {
+        const void *object;
+        std::uint64_t unlinked; // the epoch the object was unlinked in.
+        void (*deleter)(const void *);
+
+        inline void free()
+        { deleter(object); }
+    };
+
+    std::atomic<std::uint64_t> _epoch; // the global epoch, from 1 - 0 marks a free slot.
+    std::size_t _slotCount;
+    std::unique_ptr<Slot[]> _slots;
+    std::vector<Retired> _retired;
+    std::atomic<std::size_t> _retiredCount{0}; // the size of _retired, for anyone to read.
+};
+
+/**
+ * RcuHashMap class - a HashMap for read-mostly data, like a database that is reloaded a few
+ * times an hour and searched all the time. Readers take no locks: read() returns a guard to the
+ * current table, which stays valid as long as the guard lives, whatever the writers do. A write
+ * copies the table (or builds a new one), changes the copy - a rehash included - and publishes
+ * it with a single atomic store, so a reader sees either the whole old table or the whole new
+ * one, never a half built one. The old table is freed by an EpochDomain once its last reader is
+ * gone - by the next write, or by the first reader that leaves after that, so an old database
+ * doesn't stay in memory until the next reload. Writes are serialized by a mutex and cost a copy
+ * of the table, so batch them in update().
+ * @tparam KeyT, ValueT, Hash, KeyEqual, Allocator, Storage, Resize the HashMap of the tables.
+ */
+template<typename KeyT, typename ValueT, typename Hash = DefaultHash<KeyT>,
+        typename KeyEqual = std::equal_to<>,
+        typename Allocator = std::allocator<std::pair<KeyT, ValueT>>,
+        typename Storage = FlatStorage, typename Resize = EagerShrink>
+class RcuHashMap
+{
+public:
+    typedef HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator, Storage, Resize> Map;
+
+    /**
+     * ReadGuard class - a reader of one table. The table can be used, with any const function
+     * of HashMap, until the guard is destroyed - keep guards short lived, a guard that lives
+     * keeps every table published after its own from being freed.
+     */
+    class ReadGuard
+    {
+    public:
+        /**
+         * Constructor - enter the epoch domain, then read the current table.
+         * @param owner the map to read.
+         */
+        explicit ReadGuard(const RcuHashMap &owner) : _owner(&owner),
+                                                      _slot(owner._domain.enter()),
+                                                      _map(owner._current.load())
+        {}
+
+        ReadGuard(const ReadGuard &other) = delete;
+
+        ReadGuard &operator=(const ReadGuard &other) = delete;
+
+        /**
+         * Move constructor - the other guard doesn't read anymore.
+         * @param other the guard to move.
+         */
+        ReadGuard(ReadGuard &&other) noexcept : _owner(other._owner), _slot(other._slot),
+                                                _map(other._map)
+        { other._owner = nullptr; }
+
+        /**
+         * Destructor - leave the epoch domain, and if there are old tables, free the ones no
+         * reader uses anymore - unless a writer is busy, it frees them then.
+         */
+        ~ReadGuard()
+        {
+            if (_owner != nullptr)
+            {
+                _owner->_domain.leave(_slot);
+                if (_owner->_domain.retired() != 0)
+                {
+                    _owner->_tryCollect();
+                }
+            }
+        }
+
+        /**
+         * * operator.
+         * @return the table.
+         */
+        inline const Map &operator*() const
+        { return *_map; }
+
+        /**
+         * -> operator.
+         * @return address of the table.
+         */
+        inline const Map *operator->() const
+        { return _map; }
+
+    private:
+        const RcuHashMap *_owner; // nullptr after a move.
+        std::size_t _slot;
+        const Map *_map;
+    };
+
+    /**
+     * Constructor - an empty table.
+     * @param readerSlots the number of readers that can be in at once.
+     */
+    explicit RcuHashMap(const std::size_t &readerSlots = DEFAULT_READER_SLOTS) :
+            _domain(readerSlots), _current(new Map())
+    {}
+
+    /**
+     * Constructor given the first table.
+     * @param map the table.
+     * @param readerSlots the number of readers that can be in at once.
+     */
+    explicit RcuHashMap(Map map, const std::size_t &readerSlots = DEFAULT_READER_SLOTS) :
+            _domain(readerSlots), _current(new Map(std::move(map)))
+    {}
+
+    RcuHashMap(const RcuHashMap &other) = delete;
+
+    RcuHashMap &operator=(const RcuHashMap &other) = delete;
+
+    /**
+     * Destructor - free the current table (the old ones are freed by the domain). No reader may
+     * be in.
+     */
+    ~RcuHashMap()
+    {
+        delete _current.load();
+    }
+
+    /**
+     * @return a guard to the current table.
+     */
+    inline ReadGuard read() const
+    { return ReadGuard(*this); }
+
+    /**
+     * Replace the whole table - like a reload of the data. Readers that are in go on with the old
+     * table, new readers get this one.
+     * @param map the new table.
+     */
+    void publish(Map map)
+    {
+        std::unique_ptr<Map> replacement(new Map(std::move(map)));
+        std::lock_guard<std::mutex> lock(_writerMutex);
+        _replace(replacement.release());
+    }
+
+    /**
+     * Change a copy of the table, and publish it. Throws what function throws - the table
+     * doesn't change then.
+     * @tparam Function callable with (Map &).
+     * @param function called with the copy of the table.
+     */
+    template<typename Function>
+    void update(Function function)
+    {
+        std::lock_guard<std::mutex> lock(_writerMutex);
+        std::unique_ptr<Map> copy(new Map(*_current.load()));
+        function(*copy);
+        _replace(copy.release());
+    }
+
+    /**
+     * Insert a pair, or assign the value if the key is already in the table.
+     * @param key KeyT value.
+     * @param value ValueT value.
+     */
+    void insert_or_assign(const KeyT &key, const ValueT &value)
+    {
+        update([&key, &value](Map &map)
+               { map.insert_or_assign(key, value); });
+    }
+
+    /**
+     * Erase a pair.
+     * @param key KeyT value.
+     */
+    void erase(const KeyT &key)
+    {
+        update([&key](Map &map)
+               { map.erase(key); });
+    }
+
+    /**
+     * Free the old tables that no reader uses anymore.
+     */
+    void collect()
+    {
+        std::lock_guard<std::mutex> lock(_writerMutex);
+        _domain.collect();
+    }
+
+    /**
+     * Wait until all the old tables are freed - until the readers that were in when they were
+     * replaced leave. Writers wait meanwhile.
+     */
+    void synchronize()
+    {
+        std::lock_guard<std::mutex> lock(_writerMutex);
+        for (_domain.collect(); _domain.retired() != 0; _domain.collect())
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    /**
+     * @return the number of old tables that readers may still use.
+     */
+    inline std::size_t retired() const
+    { return _domain.retired(); }
+
+private:
+    mutable EpochDomain _domain;
+    std::atomic<const Map *> _current; // the published table.
+    mutable std::mutex _writerMutex; // readers take it only to free old tables, if it is free.
+
+    /**
+     * Free the old tables that no reader uses anymore, if no writer holds _writerMutex.
+     */
+    void _tryCollect() const
+    {
+        std::unique_lock<std::mutex> lock(_writerMutex, std::try_to_lock);
+        if (lock.owns_lock())
+        {
+            _domain.collect();
+        }
+    }
+
+    /**
+     * Publish a table, and retire the one it replaces. _writerMutex must be held.
+     * @param map the new table.
+     */
+    void _replace(const Map *map)
+    {
+        const Map *old = _current.exchange(map);
+        _domain.retire(old);
+    }
+};
+
+#endif //RCU_HASHMAP_HPP
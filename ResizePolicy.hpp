@@ -0,0 +1,116 @@
+/**
+ * @file ResizePolicy.hpp
+ * @author Aviad Dudkevich
+ * @brief Policies that decide when HashMap changes its capacity, and to what.
+ */
+#ifndef RESIZE_POLICY_HPP
+#define RESIZE_POLICY_HPP
+
+// Constants
+const long TABLE_FACTOR = 2;
+
+/**
+ * DoublingGrowth struct - the growth part of every resize policy: multiply the capacity by
+ * TABLE_FACTOR until the pairs fit under the upper load factor.
+ */
+struct DoublingGrowth
+{
+    /**
+     * @param newSize the number of pairs the table should hold.
+     * @param capacity the current capacity.
+     * @param upperLoadFactor double.
+     * @return the capacity for newSize pairs - the current one if they already fit.
+     */
+    static long grownCapacity(const long &newSize, const long &capacity,
+                              const double &upperLoadFactor)
+    {
+        long newCapacity = capacity;
+        while (((double) newSize / newCapacity) > upperLoadFactor)
+        {
+            newCapacity *= TABLE_FACTOR;
+        }
+        return newCapacity;
+    }
+};
+
+/**
+ * EagerShrink struct - resize policy that divides the capacity by TABLE_FACTOR as soon as an
+ * erase takes the load factor under the lower load factor. Keeps the memory tight, but when the
+ * lower and upper load factors are close, inserts and erases in waves around the boundary grow
+ * and shrink the table again and again.
+ */
+struct EagerShrink : DoublingGrowth
+{
+    /**
+     * @param size the number of pairs in the table.
+     * @param capacity the current capacity.
+     * @param lowerLoadFactor double.
+     * @param upperLoadFactor double.
+     * @return the capacity after an erase - the current one if the table shouldn't shrink.
+     */
+    static long shrunkCapacity(const long &size, const long &capacity,
+                               const double &lowerLoadFactor, const double &upperLoadFactor)
+    {
+        (void) upperLoadFactor;
+        const long newCapacity = capacity / TABLE_FACTOR;
+        // a table smaller than its number of pairs is not possible with open addressing.
+        if (((double) size / capacity) < lowerLoadFactor && capacity != 1 && size <= newCapacity)
+        {
+            return newCapacity;
+        }
+        return capacity;
+    }
+};
+
+/**
+ * HysteresisShrink struct - resize policy that shrinks only if the load factor of the smaller
+ * table is at most halfway between the lower and upper load factors. A shrink is then never
+ * followed by a grow after a few inserts, or a grow by a shrink after a few erases.
+ */
+struct HysteresisShrink : DoublingGrowth
+{
+    /**
+     * @param size the number of pairs in the table.
+     * @param capacity the current capacity.
+     * @param lowerLoadFactor double.
+     * @param upperLoadFactor double.
+     * @return the capacity after an erase - the current one if the table shouldn't shrink.
+     */
+    static long shrunkCapacity(const long &size, const long &capacity,
+                               const double &lowerLoadFactor, const double &upperLoadFactor)
+    {
+        const long newCapacity = capacity / TABLE_FACTOR;
+        const double middle = (lowerLoadFactor + upperLoadFactor) / 2;
+        if (((double) size / capacity) < lowerLoadFactor && capacity != 1 &&
+            ((double) size / newCapacity) <= middle)
+        {
+            return newCapacity;
+        }
+        return capacity;
+    }
+};
+
+/**
+ * ExplicitShrink struct - resize policy that never shrinks on erase, only when
+ * HashMap::shrink_to_fit() is called. Best for maps that fill, empty and fill again.
+ */
+struct ExplicitShrink : DoublingGrowth
+{
+    /**
+     * @param size ignored.
+     * @param capacity the current capacity.
+     * @param lowerLoadFactor ignored.
+     * @param upperLoadFactor ignored.
+     * @return the current capacity.
+     */
+    static long shrunkCapacity(const long &size, const long &capacity,
+                               const double &lowerLoadFactor, const double &upperLoadFactor)
+    {
+        (void) size;
+        (void) lowerLoadFactor;
+        (void) upperLoadFactor;
+        return capacity;
+    }
+};
+
+#endif //RESIZE_POLICY_HPP
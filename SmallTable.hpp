@@ -0,0 +1,507 @@
+/**
+ * @file SmallTable.hpp
+ * @author Aviad Dudkevich
+ * @brief Storage engine for HashMap that keeps a few pairs inline, inside the HashMap object, and
+ * allocates a table of another engine only when they don't fit.
+ */
+#ifndef SMALL_TABLE_HPP
+#define SMALL_TABLE_HPP
+
+#include <cstddef>
+#include <new>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include "ChainedTable.hpp"
+#include "HashedEntry.hpp"
+
+/**
+ * SmallTable class - hash table storage for maps that are usually tiny. Up to N pairs are kept in
+ * an array inside the table object, with the hash values of their keys, and searched linearly -
+ * keys are compared only if the hash values are equal. Constructing, copying and destroying a
+ * small map allocates nothing, and a lookup reads a few cache lines next to the map itself.
+ * The inner table is allocated with the (N + 1)th pair, and all the pairs move to it; a rehash
+ * that leaves at most N pairs moves them back inline and frees it. The inline pairs are kept in
+ * the order they were added, and move in that order, so over OrderedStorage the table keeps the
+ * insertion order too.
+ * While the pairs are inline, the capacity is only the number the HashMap keeps its load factor
+ * by - the inner table is allocated with it.
+ * The pairs must have a move constructor that doesn't throw, since moving the table moves them.
+ * @tparam KeyT type argument for generic key.
+ * @tparam ValueT type argument for generic value.
+ * @tparam Hash hash function object for KeyT.
+ * @tparam KeyEqual function object that compares two keys.
+ * @tparam Allocator allocator of pairs - only the inner table allocates.
+ * @tparam Storage the storage policy of the inner table, of a single table - to resize
+ * incrementally, use IncrementalStorage<SmallStorage<...>>.
+ * @tparam N the number of pairs kept inline.
+ */
+template<typename KeyT, typename ValueT, typename Hash, typename KeyEqual, typename Allocator,
+        typename Storage, int N>
+class SmallTable
+{
+    typedef typename Storage::template Table<KeyT, ValueT, Hash, KeyEqual, Allocator> Inner;
+    typedef typename Inner::Position InnerPosition;
+
+public:
+    typedef std::pair<KeyT, ValueT> value_type;
+    typedef Allocator allocator_type;
+
+    static_assert(N > 0, "SmallTable must keep at least one pair inline");
+    static_assert(std::is_nothrow_move_constructible<value_type>::value,
+                  "SmallTable moves the inline pairs, their move constructor must not throw");
+
+    /**
+     * Position of an element - an index of an inline pair, or a position in the inner table.
+     */
+    struct Position
+    {
+        bool isInline;
+        long index;
+        InnerPosition position;
+
+        inline bool operator==(const Position &other) const
+        {
+            return isInline == other.isInline &&
+                   (isInline ? index == other.index : position == other.position);
+        }
+
+        inline bool operator!=(const Position &other) const
+        { return !(*this == other); }
+    };
+
+    /**
+     * Constructor given the capacity - nothing is allocated.
+     * @param capacity long, must be a power of 2.
+     * @param allocator the allocator of the inner table.
+     */
+    explicit SmallTable(const long &capacity, const Allocator &allocator = Allocator()) :
+            _allocator(allocator), _capacity(capacity), _count(0)
+    {}
+
+    /**
+     * Copy constructor - copy the inline pairs, or the inner table.
+     * @param other another SmallTable.
+     */
+    SmallTable(const SmallTable &other) : _allocator(other._allocator),
+                                          _capacity(other._capacity), _count(0),
+                                          _inner(other._inner)
+    {
+        try
+        {
+            for (; _count < other._count; ++_count)
+            {
+                ::new(static_cast<void *>(_slot(_count))) Entry(*other._slot(_count));
+            }
+        }
+        catch (...)
+        {
+            _destroyInline();
+            throw;
+        }
+    }
+
+    /**
+     * Move constructor. The other table is left without pairs.
+     * @param other rvalue reference to SmallTable.
+     */
+    SmallTable(SmallTable &&other) noexcept : _allocator(other._allocator),
+                                              _capacity(other._capacity), _count(0),
+                                              _inner(std::move(other._inner))
+    {
+        for (; _count < other._count; ++_count)
+        {
+            ::new(static_cast<void *>(_slot(_count))) Entry(std::move(*other._slot(_count)));
+        }
+        other._destroyInline();
+        other._inner.reset();
+    }
+
+    /**
+     * Destructor.
+     */
+    ~SmallTable()
+    {
+        _destroyInline();
+    }
+
+    SmallTable &operator=(const SmallTable &other) = delete;
+
+    /**
+     * @return the capacity of the inner table, or the capacity it will be allocated with while
+     * the pairs are inline.
+     */
+    inline long capacity() const
+    { return _inner ? _inner->capacity() : _capacity; }
+
+    /**
+     * @return the allocator of the table.
+     */
+    inline Allocator get_allocator() const
+    { return _allocator; }
+
+    /**
+     * @return the number of pairs in the table.
+     */
+    inline long size() const
+    { return _inner ? _inner->size() : _count; }
+
+    /**
+     * @param key KeyT value, or a key-like value if Hash is transparent.
+     * @return the hash value of the key.
+     */
+    template<typename K>
+    inline static std::size_t hashOf(const K &key)
+    { return Inner::hashOf(key); }
+
+    /**
+     * Search for the pair with the given key.
+     * @param key KeyT value, or a key-like value comparable to KeyT with KeyEqual.
+     * @param hash the hash value of key.
+     * @return position of the pair, or end() if there is no pair with that key.
+     */
+    template<typename K>
+    Position find(const K &key, const std::size_t &hash) const
+    {
+        if (_inner)
+        {
+            return _outer(_inner->find(key, hash));
+        }
+        for (long i = 0; i < _count; ++i)
+        {
+            const Entry &entry = *_slot(i);
+            if (entry.hashMatches(hash) && KeyEqual{}(entry.value.first, key))
+            {
+                return Position{true, i, InnerPosition{}};
+            }
+        }
+        return end();
+    }
+
+    /**
+     * Start loading the inner table slots of the given hash value. Inline pairs are in the table
+     * object itself, so there is nothing to load for them.
+     * @param hash hash value of a key.
+     */
+    inline void prefetch(const std::size_t &hash) const
+    {
+        if (_inner)
+        {
+            _inner->prefetch(hash);
+        }
+    }
+
+    /**
+     * Search for the pair with the given key, and if it is missing - where to add it. An inline
+     * pair is always added at the end, so the position is end() while the pairs are inline.
+     * @param key KeyT value, or a key-like value comparable to KeyT with KeyEqual.
+     * @param hash the hash value of key.
+     * @return the position of the pair and true, or the position for emplaceAt() and false if
+     * there is no pair with that key.
+     */
+    template<typename K>
+    std::pair<Position, bool> findOrPrepareInsert(const K &key, const std::size_t &hash) const
+    {
+        if (_inner)
+        {
+            const std::pair<InnerPosition, bool> found = _inner->findOrPrepareInsert(key, hash);
+            return {_outer(found.first), found.second};
+        }
+        const Position position = find(key, hash);
+        return {position, position != end()};
+    }
+
+    /**
+     * Construct a new pair in the table. Assumption: there is no pair with the same key.
+     * @param hash the hash value of the key of the new pair.
+     * @param args arguments for the pair constructor.
+     * @return position of the new pair.
+     */
+    template<typename... Args>
+    inline Position emplace(const std::size_t &hash, Args &&... args)
+    { return emplaceAt(end(), hash, std::forward<Args>(args)...); }
+
+    /**
+     * Construct a new pair at the end of the inline pairs, or in the inner table in the position
+     * returned by findOrPrepareInsert(). If the inline pairs are full, the inner table is
+     * allocated and they all move to it - a failure leaves them inline.
+     * @param position position returned by findOrPrepareInsert(), or end().
+     * @param hash the hash value of the key of the new pair.
+     * @param args arguments for the pair constructor.
+     * @return position of the new pair.
+     */
+    template<typename... Args>
+    Position emplaceAt(const Position &position, const std::size_t &hash, Args &&... args)
+    {
+        if (_inner)
+        {
+            return _outer(position.isInline ? _inner->emplace(hash, std::forward<Args>(args)...) :
+                          _inner->emplaceAt(position.position, hash,
+                                            std::forward<Args>(args)...));
+        }
+        if (_count < N)
+        {
+            ::new(static_cast<void *>(_slot(_count))) Entry(hash, std::forward<Args>(args)...);
+            return Position{true, _count++, InnerPosition{}};
+        }
+        return _outer(_spill(hash, std::forward<Args>(args)...));
+    }
+
+    /**
+     * Remove the pair in the given position. The inline pairs after it move one place down, so
+     * the order of the others doesn't change.
+     * @param position position of existing pair.
+     * @return position of the pair after it in iteration order, or end() if it was the last one.
+     */
+    Position erase(const Position &position)
+    {
+        if (!position.isInline)
+        {
+            return _outer(_inner->erase(position.position));
+        }
+        --_count;
+        _slot(position.index)->~Entry();
+        for (long i = position.index; i < _count; ++i)
+        {
+            ::new(static_cast<void *>(_slot(i))) Entry(std::move(*_slot(i + 1)));
+            _slot(i + 1)->~Entry();
+        }
+        return position;
+    }
+
+    /**
+     * @param position position of existing pair.
+     * @return reference to the pair.
+     */
+    inline value_type &get(const Position &position)
+    { return position.isInline ? _slot(position.index)->value : _inner->get(position.position); }
+
+    /**
+     * @param position position of existing pair.
+     * @return const reference to the pair.
+     */
+    inline const value_type &get(const Position &position) const
+    { return position.isInline ? _slot(position.index)->value : _inner->get(position.position); }
+
+    /**
+     * @param position position of existing pair.
+     * @return the hash value of the key of the pair.
+     */
+    inline std::size_t hashAt(const Position &position) const
+    {
+        return position.isInline ? _slot(position.index)->cachedHash :
+               _inner->hashAt(position.position);
+    }
+
+    /**
+     * @return position of the first pair, or end() if the table is empty.
+     */
+    inline Position begin() const
+    { return _inner ? _outer(_inner->begin()) : Position{true, 0, InnerPosition{}}; }
+
+    /**
+     * @param position position of existing pair.
+     * @return position of the pair after it, or end() if it is the last one.
+     */
+    inline Position next(const Position &position) const
+    {
+        return position.isInline ? Position{true, position.index + 1, InnerPosition{}} :
+               _outer(_inner->next(position.position));
+    }
+
+    /**
+     * @return position after the last pair.
+     */
+    inline Position end() const
+    { return _inner ? _outer(_inner->end()) : Position{true, _count, InnerPosition{}}; }
+
+    /**
+     * @param hash hash value of a key.
+     * @return the number of pairs in the bucket of that hash - for inline pairs, the pairs that
+     * would be in that bucket of a table with the same capacity.
+     */
+    long bucketSize(const std::size_t &hash) const
+    {
+        if (_inner)
+        {
+            return _inner->bucketSize(hash);
+        }
+        const std::size_t mask = (std::size_t) _capacity - 1;
+        long result = 0;
+        for (long i = 0; i < _count; ++i)
+        {
+            if ((_slot(i)->cachedHash & mask) == (hash & mask))
+            {
+                ++result;
+            }
+        }
+        return result;
+    }
+
+    /**
+     * Erase all pairs, keep the capacity - and the inner table, if there is one.
+     */
+    void clear()
+    {
+        if (_inner)
+        {
+            _inner->clear();
+        }
+        _destroyInline();
+    }
+
+    /**
+     * Change the capacity. If at most N pairs are left, they move inline and the inner table is
+     * freed; the pairs are copied instead only if their move constructor may throw, so a failed
+     * rehash leaves the table as it was.
+     * @param newCapacity the capacity of the new table, must be a power of 2 and bigger than
+     * size().
+     */
+    void rehash(const long &newCapacity)
+    {
+        if (_inner && _inner->size() <= N)
+        {
+            try
+            {
+                for (InnerPosition i = _inner->begin(); i != _inner->end(); i = _inner->next(i))
+                {
+                    ::new(static_cast<void *>(_slot(_count))) Entry(
+                            _inner->hashAt(i), std::move_if_noexcept(_inner->get(i)));
+                    ++_count;
+                }
+            }
+            catch (...)
+            {
+                _destroyInline();
+                throw;
+            }
+            _inner.reset();
+        }
+        if (_inner)
+        {
+            _inner->rehash(newCapacity);
+        }
+        _capacity = newCapacity;
+    }
+
+    /**
+     * Aid swap of HashMap.
+     * @param first SmallTable reference.
+     * @param second SmallTable reference.
+     */
+    friend void swap(SmallTable &first, SmallTable &second) noexcept
+    {
+        using std::swap;
+        SmallTable &longer = first._count < second._count ? second : first;
+        SmallTable &shorter = first._count < second._count ? first : second;
+        long i = 0;
+        for (; i < shorter._count; ++i)
+        {
+            swap(*first._slot(i), *second._slot(i));
+        }
+        for (; i < longer._count; ++i)
+        {
+            ::new(static_cast<void *>(shorter._slot(i))) Entry(std::move(*longer._slot(i)));
+            longer._slot(i)->~Entry();
+        }
+        swap(first._count, second._count);
+        swap(first._allocator, second._allocator);
+        swap(first._capacity, second._capacity);
+        first._inner.swap(second._inner);
+    }
+
+private:
+    typedef HashedEntry<value_type, true> Entry;
+
+    Allocator _allocator;
+    long _capacity; // the capacity of the inner table, when it is allocated.
+    long _count; // the number of inline pairs - 0 if there is an inner table.
+    std::optional<Inner> _inner; // the table of the pairs if they don't fit inline.
+    alignas(Entry) unsigned char _inline[N * sizeof(Entry)]; // the first _count are pairs.
+
+    /**
+     * @param index index of an inline pair.
+     * @return pointer to the pair.
+     */
+    inline Entry *_slot(const long &index)
+    { return std::launder(reinterpret_cast<Entry *>(_inline)) + index; }
+
+    /**
+     * @param index index of an inline pair.
+     * @return const pointer to the pair.
+     */
+    inline const Entry *_slot(const long &index) const
+    { return std::launder(reinterpret_cast<const Entry *>(_inline)) + index; }
+
+    /**
+     * @param position position in the inner table.
+     * @return the same position in this table.
+     */
+    inline static Position _outer(const InnerPosition &position)
+    { return Position{false, 0, position}; }
+
+    /**
+     * Destroy the inline pairs.
+     */
+    void _destroyInline()
+    {
+        for (; _count > 0; --_count)
+        {
+            _slot(_count - 1)->~Entry();
+        }
+    }
+
+    /**
+     * Allocate the inner table with the inline pairs and then the new pair - in the order they
+     * were added, for an inner table that keeps it - and free the inline ones. If it fails, the
+     * pairs that moved already move back, so the table is as it was.
+     * @param hash the hash value of the key of the new pair.
+     * @param args arguments for the pair constructor.
+     * @return position of the new pair in the inner table.
+     */
+    template<typename... Args>
+    InnerPosition _spill(const std::size_t &hash, Args &&... args)
+    {
+        Inner table(_capacity, _allocator);
+        InnerPosition moved[N], result;
+        long i = 0;
+        try
+        {
+            for (; i < _count; ++i)
+            {
+                moved[i] = table.emplace(_slot(i)->cachedHash, std::move(_slot(i)->value));
+            }
+            result = table.emplace(hash, std::forward<Args>(args)...);
+        }
+        catch (...)
+        {
+            while (i > 0)
+            {
+                --i;
+                _slot(i)->~Entry();
+                ::new(static_cast<void *>(_slot(i))) Entry(table.hashAt(moved[i]),
+                                                           std::move(table.get(moved[i])));
+            }
+            throw;
+        }
+        _destroyInline();
+        _inner.emplace(std::move(table));
+        return result;
+    }
+};
+
+/**
+ * Storage policy for HashMap - up to N pairs inline, with no allocation, and another storage
+ * policy for more.
+ * @tparam Storage the storage policy of the table for more than N pairs, like ChainedStorage,
+ * FlatStorage or OrderedStorage.
+ * @tparam N the number of pairs kept inline.
+ */
+template<typename Storage = ChainedStorage, int N = 8>
+struct SmallStorage
+{
+    template<typename KeyT, typename ValueT, typename Hash, typename KeyEqual, typename Allocator>
+    using Table = SmallTable<KeyT, ValueT, Hash, KeyEqual, Allocator, Storage, N>;
+};
+
+#endif //SMALL_TABLE_HPP
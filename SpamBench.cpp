@@ -0,0 +1,180 @@
+/**
+ * @file SpamBench.cpp
+ * @author Aviad Dudkevich
+ * @brief Benchmarks of SpamDetector - loading a database, and scoring a massage with every engine
+ * and with a database image - on synthetic databases of sequences of 1 to MAX_SEQUENCE_WORDS
+ * words, so there are many sequence lengths. Built as spam_bench with Google Benchmark.
+ */
+#include <cstdio>
+#include <filesystem>
+#include <map>
+#include <random>
+#include <benchmark/benchmark.h>
+#include "SpamDetector.hpp"
+
+// Constants
+static const int VOCABULARY_SIZE = 20000;
+static const int MIN_WORD_LENGTH = 2;
+static const int MAX_WORD_LENGTH = 10;
+static const int MAX_SEQUENCE_WORDS = 4;
+static const int MAX_SCORE = 9;
+static const long MIN_SEQUENCES = 1 << 12;
+static const long MAX_SEQUENCES = 1 << 20;
+// the automaton of a big database takes seconds to build, and is built again for every run.
+static const long MAX_AUTOMATON_SEQUENCES = 1 << 16;
+static const long MIN_MASSAGE_BYTES = 1 << 16;
+static const long MAX_MASSAGE_BYTES = 1 << 22;
+static const int RANGE_MULTIPLIER = 16;
+static const unsigned int BENCH_SEED = 7;
+static const double NEVER_SPAM = 1e18; // a threshold no score reaches, so no scan stops early.
+
+/**
+ * The files of one benchmark - a database, its image, and a massage - written once to the
+ * temporary directory, and removed at exit.
+ */
+struct BenchFiles
+{
+    string database, image, massage;
+
+    ~BenchFiles()
+    {
+        std::remove(database.c_str());
+        std::remove(image.c_str());
+        std::remove(massage.c_str());
+    }
+};
+
+/**
+ * @param random the random generator.
+ * @return a vocabulary of random lower case words.
+ */
+vector<string> makeWords(std::mt19937 &random)
+{
+    std::uniform_int_distribution<int> length(MIN_WORD_LENGTH, MAX_WORD_LENGTH), letter('a', 'z');
+    vector<string> words(VOCABULARY_SIZE);
+    for (string &word: words)
+    {
+        for (int i = length(random); i > 0; --i)
+        {
+            word.push_back((char) letter(random));
+        }
+    }
+    return words;
+}
+
+/**
+ * Write a database and a massage of the words of one vocabulary, and compile the image of the
+ * database. The files are kept for all the benchmarks with the same sizes.
+ * @param sequences the number of lines of the database.
+ * @param massageBytes the size of the massage.
+ * @return the files.
+ */
+const BenchFiles &benchFiles(const long &sequences, const long &massageBytes)
+{
+    static std::map<std::pair<long, long>, BenchFiles> cache;
+    const std::pair<long, long> sizes(sequences, massageBytes);
+    if (cache.count(sizes) != 0)
+    {
+        return cache[sizes];
+    }
+    BenchFiles &files = cache[sizes];
+    const string prefix = (std::filesystem::temp_directory_path() /
+                           ("spam_bench_" + std::to_string(sequences) + "_" +
+                            std::to_string(massageBytes))).string();
+    files.database = prefix + ".csv";
+    files.image = prefix + ".img";
+    files.massage = prefix + ".txt";
+    std::mt19937 random(BENCH_SEED);
+    const vector<string> words = makeWords(random);
+    std::uniform_int_distribution<int> word(0, VOCABULARY_SIZE - 1), count(1, MAX_SEQUENCE_WORDS);
+    std::uniform_int_distribution<int> score(1, MAX_SCORE);
+    set<string> written;
+    std::ofstream database(files.database, std::ios::binary | std::ios::trunc);
+    while ((long) written.size() < sequences)
+    {
+        string sequence = words[word(random)];
+        for (int i = count(random); i > 1; --i)
+        {
+            sequence += " " + words[word(random)];
+        }
+        if (written.insert(sequence).second)
+        {
+            database << sequence << COMMA << score(random) << NEW_LINE;
+        }
+    }
+    database.close();
+    std::ofstream massage(files.massage, std::ios::binary | std::ios::trunc);
+    for (long bytes = 0; bytes < massageBytes;)
+    {
+        const string &next = words[word(random)];
+        massage << next << ' ';
+        bytes += (long) next.size() + 1;
+    }
+    massage.close();
+    compileDatabase(files.database.c_str(), files.image.c_str());
+    return files;
+}
+
+/**
+ * Load a database of range(0) sequences - parse the file and build the HashMap.
+ */
+void benchCreateDatabaseMap(benchmark::State &state)
+{
+    const BenchFiles &files = benchFiles(state.range(0), MIN_MASSAGE_BYTES);
+    const MappedFile databaseFile(files.database.c_str());
+    for (auto _: state)
+    {
+        Arena arena;
+        SequenceMap databaseMap{SequenceMap::allocator_type(arena)};
+        set<size_t> wordsLen;
+        createDatabaseMap(databaseFile, databaseMap, wordsLen);
+        benchmark::DoNotOptimize(databaseMap);
+    }
+    state.SetItemsProcessed((std::int64_t) state.iterations() * state.range(0));
+    state.SetBytesProcessed((std::int64_t) (state.iterations() * databaseFile.view().size()));
+}
+
+/**
+ * Score a massage of range(1) bytes against a database of range(0) sequences, with a Scorer of
+ * the given engine - the database and the automaton are built before the timing.
+ * @param engine AUTOMATON_ENGINE or WINDOW_ENGINE.
+ * @param useImage true to score against the image of the database instead of the HashMap.
+ */
+void benchScore(benchmark::State &state, const char *engine, const bool &useImage)
+{
+    const BenchFiles &files = benchFiles(state.range(0), state.range(1));
+    withDatabase((useImage ? files.image : files.database).c_str(),
+                 [&](const auto &databaseMap, const set<size_t> &wordsLen)
+                 {
+                     const Scorer<std::decay_t<decltype(databaseMap)>> scorer(
+                             databaseMap, wordsLen, engine, NEVER_SPAM);
+                     for (auto _: state)
+                     {
+                         benchmark::DoNotOptimize(scorer.score(files.massage.c_str()));
+                     }
+                 });
+    state.SetBytesProcessed(state.iterations() * state.range(1));
+}
+
+void benchWindowScore(benchmark::State &state)
+{ benchScore(state, WINDOW_ENGINE, false); }
+
+void benchWindowImageScore(benchmark::State &state)
+{ benchScore(state, WINDOW_ENGINE, true); }
+
+void benchAutomatonScore(benchmark::State &state)
+{ benchScore(state, AUTOMATON_ENGINE, false); }
+
+BENCHMARK(benchCreateDatabaseMap)->RangeMultiplier(RANGE_MULTIPLIER)
+        ->Range(MIN_SEQUENCES, MAX_SEQUENCES)->Unit(benchmark::kMillisecond);
+BENCHMARK(benchWindowScore)->RangeMultiplier(RANGE_MULTIPLIER)
+        ->Ranges({{MIN_SEQUENCES, MAX_SEQUENCES}, {MIN_MASSAGE_BYTES, MAX_MASSAGE_BYTES}})
+        ->Unit(benchmark::kMillisecond);
+BENCHMARK(benchWindowImageScore)->RangeMultiplier(RANGE_MULTIPLIER)
+        ->Ranges({{MIN_SEQUENCES, MAX_SEQUENCES}, {MIN_MASSAGE_BYTES, MAX_MASSAGE_BYTES}})
+        ->Unit(benchmark::kMillisecond);
+BENCHMARK(benchAutomatonScore)->RangeMultiplier(RANGE_MULTIPLIER)
+        ->Ranges({{MIN_SEQUENCES, MAX_AUTOMATON_SEQUENCES}, {MIN_MASSAGE_BYTES, MAX_MASSAGE_BYTES}})
+        ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
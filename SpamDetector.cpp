@@ -5,140 +5,288 @@
  */
 #include <iostream>
 #include <fstream>
-#include <regex>
-#include <set>
-#include "HashMap.hpp"
+#include <charconv>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <sys/stat.h>
+#include "SpamDetector.hpp"
+#include "MessageStream.hpp"
+#include "ThreadPool.hpp"
 
 
 // Constants
 static const int NUMBER_OF_ARGUMENTS = 4;
 static const int DATABASE_PATH = 1;
+static const int MODE = 1;
 static const int MASSAGE_PATH = 2;
 static const int THRESHOLD = 3;
-const std::regex VALID_LINE("[^,]+,[0-9]+[\n\r]?");
+static const int MODE_DATABASE_PATH = 2;
+static const int IMAGE_PATH = 3;
+static const int LIST_PATH = 4;
+static const int BATCH_OPTIONS = 5;
 static const char *WRONG_USAGE_MSG = "Usage: SpamDetector <database path> <message path> "
-                                     "<threshold>\n";
-static const char *INVALID_INPUT_MSG = "Invalid input\n";
+                                     "<threshold> [automaton|window] [--threads <number>]\n"
+                                     "       SpamDetector --compile <database path> "
+                                     "<image path>\n"
+                                     "       SpamDetector --batch <database path> <threshold> "
+                                     "<list path> [automaton|window] [--threads <number>] "
+                                     "[--order input|completion]\n"
+                                     "       SpamDetector --stream <database path> <threshold> "
+                                     "[automaton|window]\n";
+static const char *COMPILE_MODE = "--compile";
+static const char *BATCH_MODE = "--batch";
+static const char *STREAM_MODE = "--stream";
+static const char *THREADS_OPTION = "--threads";
+static const char *ORDER_OPTION = "--order";
+static const char *INPUT_ORDER = "input";
+static const char *COMPLETION_ORDER = "completion";
 static const char *MEMORY_MSG_ERROR = "Memory error occurred\n";
 static const char *OVER_THRESHOLD_MSG = "SPAM";
 static const char *UNDER_THRESHOLD_MSG = "NOT_SPAM";
-static const char COMMA = ',';
-
-using std::string;
-using std::vector;
-using std::set;
+static const char *INVALID_MASSAGE_MSG = "INVALID";
+static const char MASSAGE_DELIMITER = '\0';
+// the massages of a batch that are scored or waiting to be printed, for every thread.
+const std::size_t BATCH_MASSAGES_PER_THREAD = 4;
+// by default a single massage gets the automaton when its frames - its size times the number of
+// sequence lengths - are at least this many times the bytes of the sequences it is built from.
+const std::size_t AUTOMATON_BREAK_EVEN = 20;
 
 /**
- * a class to represent input file error.
+ * Print the verdict of a massage - "SPAM" or "NOT_SPAM".
+ * @param spam true if the massage is spam.
  */
-class InvalidInput : public std::exception
+void printVerdict(const bool &spam)
 {
-public:
-    const char *what() const noexcept override
-    {
-        return INVALID_INPUT_MSG;
-    }
-};
+    std::cout << (spam ? OVER_THRESHOLD_MSG : UNDER_THRESHOLD_MSG) << std::endl;
+}
 
 /**
- * Take a string and making every upper case letter to low case.
- * @param str reference to a string.
- * @return reference to the string.
+ * Options of the scoring modes.
  */
-string &makeStringLowerCase(string &str)
+struct Options
 {
-    std::transform(str.begin(), str.end(), str.begin(),
-                   [](unsigned char c)
-                   { return std::tolower(c); });
-    return str;
-}
-
+    size_t threads; // the number of massages, or segments of a massage, scored at once.
+    bool completionOrder; // print the verdicts as the massages are done, each with its path.
+};
 
 /**
- * Create the HashMap from database file. Throws InvalidInput if the file invalid.
- * @param databaseFile reference to ifstream.
- * @param databaseMap reference to HashMap.
- * @param wordsLen reference to set of size_t - to keep track of all possible words length.
+ * Score every massage of a list of paths, one path in a line, and print a verdict for each -
+ * or "INVALID" for a massage that can't be read. Empty lines are skipped. Throws InvalidInput if
+ * the list can't be read.
+ * The massages are scored by a work stealing ThreadPool while the list is still being read - at
+ * most BATCH_MASSAGES_PER_THREAD for every thread are read ahead of the first one whose verdict
+ * wasn't printed, so the memory doesn't grow with the list. In input order the verdicts are
+ * printed in the order of the list, each as soon as the ones before it are; in completion order
+ * every verdict is printed once it is ready, followed by the path.
+ * This function can throw bad_alloc exception.
+ * @param scorer the Scorer of the database - shared by all the threads, read only.
+ * @param listPath the path of the list, or "-" for the standard input.
+ * @param options the number of threads and the output order.
+ * @return true if all the massages were scored, false if any was invalid.
  */
-void createDatabaseMap(std::ifstream &databaseFile, HashMap<string, int> &databaseMap,
-                       set<size_t> &wordsLen)
+template<typename Database>
+bool scoreBatch(const Scorer<Database> &scorer, const char *listPath, const Options &options)
 {
-    string line, sequence;
-    string::size_type commaIndex;
-    int score;
-    while (databaseFile.good())
+    const bool standardInput = std::strcmp(listPath, STANDARD_INPUT_PATH) == 0;
+    std::ifstream namedFile;
+    if (!standardInput)
+    {
+        namedFile.open(listPath);
+    }
+    std::istream &listFile = standardInput ? std::cin : namedFile;
+    if (!listFile.good())
+    {
+        throw InvalidInput();
+    }
+    std::mutex outputMutex; // guards everything below, and std::cout.
+    std::condition_variable printedOne; // a verdict was printed, or a massage failed.
+    std::deque<const char *> verdicts; // of the massages from printed on - nullptr until done.
+    size_t printed = 0; // the number of massages whose verdict was printed, in input order.
+    bool allValid = true;
+    bool failed = false; // a massage threw - the pool throws it again, nothing more is read.
+    ThreadPool pool(options.threads);
+    const size_t readAhead = pool.size() * BATCH_MASSAGES_PER_THREAD;
+    string massagePath;
+    for (size_t index = 0; std::getline(listFile, massagePath);)
     {
-        std::getline(databaseFile, line);
-        if (!std::regex_match(line, VALID_LINE))
+        if (!massagePath.empty() && massagePath.back() == CARRIAGE_RETURN)
+        {
+            massagePath.pop_back();
+        }
+        if (massagePath.empty())
         {
-            if (line.empty() && databaseFile.eof())
+            continue;
+        }
+        {
+            std::unique_lock<std::mutex> lock(outputMutex);
+            printedOne.wait(lock, [&]
+            { return verdicts.size() < readAhead || failed; });
+            if (failed)
             {
                 break;
             }
-            throw InvalidInput();
-        }
-        commaIndex = line.find(COMMA);
-        sequence = line.substr(0, commaIndex);
-        makeStringLowerCase(sequence);
-        score = std::stoi(line.substr(commaIndex + 1));
-        if (score < 0)
-        {
-            throw InvalidInput();
+            verdicts.push_back(nullptr);
         }
-        databaseMap[sequence] = score;
-        wordsLen.emplace(sequence.size());
+        pool.submit([&, index, massagePath]()
+                    {
+                        const char *verdict = INVALID_MASSAGE_MSG;
+                        try
+                        {
+                            verdict = scorer.isSpam(scorer.score(massagePath.c_str())) ?
+                                      OVER_THRESHOLD_MSG : UNDER_THRESHOLD_MSG;
+                        }
+                        catch (InvalidInput &ex)
+                        {
+                            // the verdict stays INVALID_MASSAGE_MSG.
+                        }
+                        catch (...)
+                        {
+                            std::lock_guard<std::mutex> lock(outputMutex);
+                            failed = true;
+                            printedOne.notify_one();
+                            throw;
+                        }
+                        std::lock_guard<std::mutex> lock(outputMutex);
+                        allValid = allValid && verdict != INVALID_MASSAGE_MSG;
+                        verdicts[index - printed] = verdict;
+                        if (options.completionOrder)
+                        {
+                            std::cout << verdict << ' ' << massagePath << std::endl;
+                        }
+                        while (!verdicts.empty() && verdicts.front() != nullptr)
+                        {
+                            if (!options.completionOrder)
+                            {
+                                std::cout << verdicts.front() << std::endl;
+                            }
+                            verdicts.pop_front();
+                            ++printed;
+                            printedOne.notify_one();
+                        }
+                    });
+        ++index;
     }
-    if (databaseFile.fail() && !databaseFile.eof())
+    pool.wait(); // throws bad_alloc of a massage, if any.
+    if (listFile.bad())
     {
         throw InvalidInput();
     }
+    return allValid;
 }
 
 /**
- * Calculate the score to the given massage file based on databaseMap. To avoid missing any
- * possible sequence - I used brute force. For every size of possible sequence in database -
- * search all the input massage with all possible frames of that size.
- * This function can throw bad_alloc exception.
- * @param massageFile reference to ifstream.
- * @param databaseMap reference to HashMap.
- * @param wordsLen reference to set of size_t.
- * @return the score the massage gets based on database.
+ * Parse the options after the required arguments - any of: the engine, "--threads <number>" and
+ * "--order input|completion".
+ * @param argc argument counter.
+ * @param argv arguments vector.
+ * @param first the index of the first option.
+ * @param engine set to the engine, if it is given.
+ * @param options set to the options that are given.
+ * @return true if all the options are valid.
  */
-int generateScore(std::ifstream &massageFile, HashMap<string, int> &databaseMap,
-                  set<size_t> &wordsLen)
+bool parseOptions(const int &argc, char *argv[], const int &first, string &engine,
+                  Options &options)
 {
-
-    int result = 0;
-    if (!wordsLen.empty())
+    for (int i = first; i < argc; ++i)
     {
-        char *currentSequence = new char[*wordsLen.rbegin()]; // can throw bad_alloc
-        string currentString;
-        std::streampos cursor = massageFile.tellg();
-        for (size_t currentLen: wordsLen)
+        const std::string_view option(argv[i]);
+        if (option == AUTOMATON_ENGINE || option == WINDOW_ENGINE)
+        {
+            engine = argv[i];
+        }
+        else if (option == THREADS_OPTION && i + 1 < argc)
         {
-            while (massageFile.readsome(currentSequence, currentLen) ==
-                   static_cast<std::streamsize> (currentLen)) //check frame
+            const std::string_view value(argv[++i]);
+            const std::from_chars_result parsed = std::from_chars(value.data(), value.data() +
+                                                                                value.size(),
+                                                                  options.threads);
+            if (parsed.ec != std::errc() || parsed.ptr != value.data() + value.size() ||
+                options.threads == 0)
             {
-                currentString = string(currentSequence, currentLen);
-                makeStringLowerCase(currentString);
-                if (databaseMap.containsKey(currentString))
-                {
-                    result += databaseMap[currentString];
-                }
-                massageFile.seekg(cursor);
-                massageFile.seekg(1, std::ios::cur); // go back and increase cursor by 1.
-                cursor = massageFile.tellg();
+                return false;
             }
-            if (massageFile.fail() && !massageFile.eof())
+        }
+        else if (option == ORDER_OPTION && i + 1 < argc)
+        {
+            const std::string_view value(argv[++i]);
+            if (value != INPUT_ORDER && value != COMPLETION_ORDER)
             {
-                throw InvalidInput();
+                return false;
             }
-            massageFile.seekg(std::ios::beg); // go to the beginning of the file.
-            cursor = massageFile.tellg();
+            options.completionOrder = value == COMPLETION_ORDER;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Pick the engine when none is given. The automaton takes a pass over all the sequences to build
+ * and scans a massage in one pass, the window engine starts at once and looks up every frame of
+ * every sequence length - so a batch or a stream of massages gets the automaton, and so does a
+ * single massage file whose frames are AUTOMATON_BREAK_EVEN times the bytes of the sequences. A
+ * smaller massage, like most single runs on an image, or one that is not a regular file (its
+ * size is not known, and its scan can stop at the threshold), gets the window engine.
+ * @param databaseMap reference to HashMap, or to DatabaseImage.
+ * @param wordsLen reference to set of size_t.
+ * @param massagePath the path of the single massage, or nullptr for many massages.
+ * @return AUTOMATON_ENGINE or WINDOW_ENGINE.
+ */
+template<typename Database>
+const char *defaultEngine(const Database &databaseMap, const set<size_t> &wordsLen,
+                          const char *massagePath)
+{
+    if (massagePath == nullptr)
+    {
+        return AUTOMATON_ENGINE;
+    }
+    struct stat status{};
+    if (!MappedFile::mappable(massagePath) || ::stat(massagePath, &status) != 0)
+    {
+        return WINDOW_ENGINE;
+    }
+    const size_t frames = (size_t) status.st_size * wordsLen.size();
+    size_t sequenceBytes = 0; // summed only until it is clear, so a small massage costs little.
+    for (const auto &sequence: databaseMap)
+    {
+        sequenceBytes += sequence.first.size();
+        if (sequenceBytes * AUTOMATON_BREAK_EVEN > frames)
+        {
+            return WINDOW_ENGINE;
         }
-        delete[] currentSequence;
     }
-    return result;
+    return AUTOMATON_ENGINE;
+}
+
+/**
+ * Score every massage of the standard input - the massages are separated by MASSAGE_DELIMITER -
+ * and print a verdict for each. Every massage is streamed, and the rest of it is skipped once
+ * its score reaches the threshold. Throws InvalidInput if the standard input can't be read.
+ * This function can throw bad_alloc exception.
+ * @param scorer the Scorer of the database.
+ */
+template<typename Database>
+void scoreMassages(const Scorer<Database> &scorer)
+{
+    MessageStream massages(std::cin, MASSAGE_DELIMITER);
+    std::istream massageFile(&massages);
+    while (massages.next())
+    {
+        massageFile.clear();
+        printVerdict(scorer.isSpam(scorer.score(massageFile)));
+    }
+    if (std::cin.bad())
+    {
+        throw InvalidInput();
+    }
 }
 
 /**
@@ -146,36 +294,82 @@ int generateScore(std::ifstream &massageFile, HashMap<string, int> &databaseMap,
  * "NOT_SPAM" if the message is spam or not. This is based on the sequences given in the database
  * file and their score. For every sequence that appear in the message file - add the score to the
  * total score. If the total score is higher then threshold - prints "SPAM", prints "NOT_SPAM"
- * otherwise.
+ * otherwise. An optional fourth argument picks the scoring engine: "automaton" or "window" (a
+ * lookup of every frame of every sequence length) - by default the one defaultEngine() picks,
+ * the automaton only when there is enough to scan to make up for building it. The massage path "-" reads the
+ * massage from the standard input - it is streamed, and the scan stops once the score reaches the
+ * threshold. The database path can also be an image written by "--compile <database path>
+ * <image path>", which is opened in place instead of parsed.
+ * The database is loaded once for many massages with "--batch <database path> <threshold>
+ * <list path>" - a file of massage paths, one in a line ("-" for the standard input) - or with
+ * "--stream <database path> <threshold>" - massages on the standard input, separated by '\0'.
+ * A verdict is printed for every massage, in order, and "INVALID" for one that can't be read.
+ * The batch mode scores the massages on "--threads <number>" threads (all the cores by default),
+ * and "--order completion" prints every verdict as soon as it is ready, followed by the path. A
+ * single massage file bigger than SEGMENT_SIZE is split to segments that are scored on that many
+ * threads.
  * @param argc argument counter.
  * @param argv arguments vector.
  * @return 0 if successful, 1 otherwise.
  */
 int main(int argc, char *argv[])
 {
-    if (argc != NUMBER_OF_ARGUMENTS)
+    const string mode = argc > MODE ? argv[MODE] : string();
+    const bool compile = mode == COMPILE_MODE, batch = mode == BATCH_MODE;
+    const bool stream = mode == STREAM_MODE;
+    const int arguments = batch ? BATCH_OPTIONS : NUMBER_OF_ARGUMENTS;
+    string engine; // empty if not given - defaultEngine() picks it then.
+    const unsigned int hardwareThreads = std::thread::hardware_concurrency();
+    Options options{hardwareThreads == 0 ? 1 : hardwareThreads, false};
+    if (argc < arguments || (compile && argc != arguments) ||
+        !parseOptions(argc, argv, arguments, engine, options))
     {
         std::cerr << WRONG_USAGE_MSG;
         return EXIT_FAILURE;
     }
     try
     {
+        if (compile)
+        {
+            compileDatabase(argv[MODE_DATABASE_PATH], argv[IMAGE_PATH]);
+            return EXIT_SUCCESS;
+        }
         const double threshold = std::stod(argv[THRESHOLD]);
         if (threshold <= 0)
         {
             throw InvalidInput();
         }
-        std::ifstream databaseFile(argv[DATABASE_PATH]), massageFile(argv[MASSAGE_PATH]);
-        HashMap<string, int> databaseMap;
-        set<size_t> wordsLen;
-        createDatabaseMap(databaseFile, databaseMap, wordsLen);
-        if (generateScore(massageFile, databaseMap, wordsLen) >= threshold)
-        {
-            std::cout << OVER_THRESHOLD_MSG << std::endl;
-        }
-        else
+        bool allValid = true;
+        // a single massage is split to segments, the massages of a batch are scored at once.
+        const size_t segmentThreads = batch || stream ? 1 : options.threads;
+        withDatabase(argv[batch || stream ? MODE_DATABASE_PATH : DATABASE_PATH],
+                     [&](const auto &databaseMap, const set<size_t> &wordsLen)
+                     {
+                         const string scorerEngine = !engine.empty() ? engine : defaultEngine(
+                                 databaseMap, wordsLen,
+                                 batch || stream ? nullptr : argv[MASSAGE_PATH]);
+                         const Scorer<std::decay_t<decltype(databaseMap)>> scorer(
+                                 databaseMap, wordsLen, scorerEngine, threshold,
+                                 segmentThreads);
+                         endPhase("build engine");
+                         if (batch)
+                         {
+                             allValid = scoreBatch(scorer, argv[LIST_PATH], options);
+                         }
+                         else if (stream)
+                         {
+                             scoreMassages(scorer);
+                         }
+                         else
+                         {
+                             printVerdict(scorer.isSpam(scorer.score(argv[MASSAGE_PATH])));
+                         }
+                         endPhase("score");
+                         reportStats(databaseMap);
+                     });
+        if (!allValid)
         {
-            std::cout << UNDER_THRESHOLD_MSG << std::endl;
+            return EXIT_FAILURE;
         }
     }
     catch (InvalidInput &ex)
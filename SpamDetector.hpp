@@ -0,0 +1,663 @@
+/**
+ * @file SpamDetector.hpp
+ * @author Aviad Dudkevich
+ * @brief The database and the scoring of SpamDetector - loading a database file or image, and
+ * scoring massages against it with either engine - shared by its main and by the benchmarks.
+ */
+#ifndef SPAM_DETECTOR_HPP
+#define SPAM_DETECTOR_HPP
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <charconv>
+#include <set>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <numeric>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <chrono>
+#include "StringHashMap.hpp"
+#include "Arena.hpp"
+#include "AhoCorasick.hpp"
+#include "MappedFile.hpp"
+#include "DatabaseImage.hpp"
+#include "ThreadPool.hpp"
+#include "Prefetch.hpp"
+
+// Constants
+// the engine names are const pointers, so a file that includes this and uses neither compiles
+// without warnings.
+const char *const AUTOMATON_ENGINE = "automaton";
+const char *const WINDOW_ENGINE = "window";
+static const char *INVALID_INPUT_MSG = "Invalid input\n";
+static const char COMMA = ',';
+static const char NEW_LINE = '\n';
+static const char CARRIAGE_RETURN = '\r';
+const std::size_t STREAM_CHUNK_SIZE = 64 * 1024;
+const std::size_t SEGMENT_SIZE = 4 * 1024 * 1024;
+
+using std::string;
+using std::vector;
+using std::set;
+
+/**
+ * a class to represent input file error.
+ */
+class InvalidInput : public std::exception
+{
+public:
+    const char *what() const noexcept override
+    {
+        return INVALID_INPUT_MSG;
+    }
+};
+
+/**
+ * @param c a char.
+ * @return the lower case of c.
+ */
+inline char lowerCase(const char &c)
+{
+    return (char) std::tolower((unsigned char) c);
+}
+
+/**
+ * Hash function object for the database - RollingHash of the lower case of the string, so the
+ * hash of a frame of the massage can be rolled over the massage as it is, without a lower case
+ * copy of it.
+ */
+struct IgnoreCaseHash
+{
+    typedef void is_transparent;
+
+    /**
+     * @param key string.
+     * @return the hash value of the lower case of the string.
+     */
+    std::size_t operator()(const std::string_view &key) const noexcept
+    {
+        std::uint64_t polynomial = 0;
+        for (const char c: key)
+        {
+            polynomial = RollingHash::append(polynomial, lowerCase(c));
+        }
+        return RollingHash::finish(polynomial);
+    }
+};
+
+/**
+ * Key equal function object for the database - compares strings ignoring case.
+ */
+struct IgnoreCaseEqual
+{
+    typedef void is_transparent;
+
+    /**
+     * @param first string.
+     * @param second string.
+     * @return true if the strings are equal ignoring case.
+     */
+    bool operator()(const std::string_view &first, const std::string_view &second) const noexcept
+    {
+        return first.size() == second.size() &&
+               std::equal(first.begin(), first.end(), second.begin(),
+                          [](const char &a, const char &b)
+                          { return lowerCase(a) == lowerCase(b); });
+    }
+};
+
+typedef StringHashMap<int, IgnoreCaseHash, IgnoreCaseEqual, ArenaAllocator<char>> SequenceMap;
+typedef DatabaseImage<IgnoreCaseHash, IgnoreCaseEqual> SequenceImage;
+
+/**
+ * Parse a line of the database file - a sequence without commas, a comma, and a score of decimal
+ * digits, optionally followed by '\r' (of a "\r\n" line end).
+ * @param line the line, without its '\n'.
+ * @param sequence set to the sequence of the line, if it is valid.
+ * @param score set to the score of the line, if it is valid.
+ * @return true if the line is valid, false otherwise (a score too big for int included).
+ */
+inline bool parseLine(const std::string_view &line, std::string_view &sequence, int &score)
+{
+    const char *begin = line.data(), *end = begin + line.size();
+    const char *comma = static_cast<const char *>(std::memchr(begin, COMMA, line.size()));
+    if (comma == nullptr || comma == begin || comma + 1 == end ||
+        !std::isdigit((unsigned char) comma[1]))
+    {
+        return false;
+    }
+    const std::from_chars_result parsed = std::from_chars(comma + 1, end, score);
+    if (parsed.ec != std::errc() || !(parsed.ptr == end || (parsed.ptr + 1 == end &&
+                                                             *parsed.ptr == CARRIAGE_RETURN)))
+    {
+        return false;
+    }
+    sequence = std::string_view(begin, comma - begin);
+    return true;
+}
+
+/**
+ * Create the HashMap from database file. Throws InvalidInput if the file invalid - if it
+ * couldn't be read, or a line is not valid for parseLine(). An empty line is valid only at the
+ * end of the file.
+ * The file is scanned in place, and the HashMap is sized once by the number of lines and the
+ * bytes of the file, so it doesn't rehash or move its key bytes while loading.
+ * This function can throw bad_alloc exception.
+ * @param databaseFile reference to MappedFile.
+ * @param databaseMap reference to HashMap.
+ * @param wordsLen reference to set of size_t - to keep track of all possible words length.
+ */
+inline void createDatabaseMap(const MappedFile &databaseFile, SequenceMap &databaseMap,
+                              set<size_t> &wordsLen)
+{
+    if (!databaseFile.good())
+    {
+        throw InvalidInput();
+    }
+    const std::string_view database = databaseFile.view();
+    databaseMap.reserve(std::count(database.begin(), database.end(), NEW_LINE) + 1,
+                        database.size());
+    std::string_view sequence;
+    int score;
+    for (size_t begin = 0; begin < database.size();)
+    {
+        const char *lineEnd = static_cast<const char *>(
+                std::memchr(database.data() + begin, NEW_LINE, database.size() - begin));
+        const size_t end = lineEnd == nullptr ? database.size() : lineEnd - database.data();
+        if (!parseLine(database.substr(begin, end - begin), sequence, score))
+        {
+            throw InvalidInput(); // an empty line too - the last one is never scanned.
+        }
+        wordsLen.emplace(sequence.size());
+        databaseMap.insert_or_assign(sequence, score); // can throw bad_alloc
+        begin = end + 1;
+    }
+}
+
+/**
+ * Sum the scores of the frames of one length in a text, from a given position - the hash of every
+ * frame is rolled from the one before it (databaseMap hashes with IgnoreCaseHash), so only
+ * frames whose hash matches are compared. The frames are taken in groups of PREFETCH_DISTANCE:
+ * all the hashes of a group are rolled and their slots prefetched before any of them is
+ * searched, so the cache misses of a large database overlap.
+ * @param text the text, as it is.
+ * @param first the position of the first frame.
+ * @param length the length of the frames.
+ * @param databaseMap reference to HashMap, or to DatabaseImage.
+ * @return the total score of the frames.
+ */
+template<typename Database>
+int scoreFrames(const std::string_view &text, const size_t &first, const size_t &length,
+                const Database &databaseMap)
+{
+    int result = 0;
+    if (length > text.size() || first > text.size() - length)
+    {
+        return result;
+    }
+    const char *data = text.data();
+    const size_t end = text.size() - length + 1; // after the last frame.
+    const std::uint64_t weight = RollingHash::firstWeight(length);
+    std::uint64_t polynomial = 0;
+    for (size_t i = first; i < first + length; ++i)
+    {
+        polynomial = RollingHash::append(polynomial, lowerCase(data[i]));
+    }
+    std::size_t hashes[PREFETCH_DISTANCE];
+    for (size_t group = first; group < end; group += PREFETCH_DISTANCE)
+    {
+        const size_t groupSize = end - group < (size_t) PREFETCH_DISTANCE ?
+                                 end - group : (size_t) PREFETCH_DISTANCE;
+        for (size_t j = 0; j < groupSize; ++j)
+        {
+            const size_t i = group + j;
+            if (i != first)
+            {
+                polynomial = RollingHash::roll(polynomial, lowerCase(data[i - 1]),
+                                               lowerCase(data[i - 1 + length]), weight);
+            }
+            hashes[j] = RollingHash::finish(polynomial);
+            databaseMap.prefetch(hashes[j]);
+        }
+        for (size_t j = 0; j < groupSize; ++j)
+        {
+            const auto entry = databaseMap.find(std::string_view(data + group + j, length),
+                                                hashes[j]);
+            if (entry != databaseMap.end())
+            {
+                result += entry->second;
+            }
+        }
+    }
+    return result;
+}
+
+/**
+ * Calculate the score to the given massage file based on databaseMap. To avoid missing any
+ * possible sequence - I used brute force. For every size of possible sequence in database -
+ * search all the input massage with all possible frames of that size. The massage is scanned in
+ * place, with scoreFrames().
+ * @param massageFile reference to MappedFile.
+ * @param databaseMap reference to HashMap, or to DatabaseImage.
+ * @param wordsLen reference to set of size_t.
+ * @return the score the massage gets based on database.
+ */
+template<typename Database>
+int generateScore(const MappedFile &massageFile, const Database &databaseMap,
+                  const set<size_t> &wordsLen)
+{
+    int result = 0;
+    if (wordsLen.empty())
+    {
+        return result;
+    }
+    if (!massageFile.good())
+    {
+        throw InvalidInput();
+    }
+    const std::string_view massage = massageFile.view();
+    for (size_t currentLen: wordsLen)
+    {
+        result += scoreFrames(massage, 0, currentLen, databaseMap);
+    }
+    return result;
+}
+
+/**
+ * Calculate the score to a massage that can only be read forward, like the standard input, with
+ * the frames of generateScore(). The massage is read in chunks of STREAM_CHUNK_SIZE, and only the
+ * last (longest sequence length - 1) bytes are kept between chunks - enough for every frame that
+ * crosses a chunk boundary - so the memory doesn't grow with the massage. The scan stops as soon
+ * as the score reaches the threshold.
+ * This function can throw bad_alloc exception.
+ * @param massageFile reference to istream.
+ * @param databaseMap reference to HashMap, or to DatabaseImage.
+ * @param wordsLen reference to set of size_t.
+ * @param threshold the score from which the massage is spam.
+ * @return the score the massage gets based on database, or a score of at least threshold.
+ */
+template<typename Database>
+int generateStreamScore(std::istream &massageFile, const Database &databaseMap,
+                        const set<size_t> &wordsLen, const double &threshold)
+{
+    int result = 0;
+    if (wordsLen.empty())
+    {
+        return result;
+    }
+    if (!massageFile.good())
+    {
+        throw InvalidInput();
+    }
+    const size_t overlap = *wordsLen.rbegin() - 1;
+    string buffer(overlap + STREAM_CHUNK_SIZE, '\0'); // can throw bad_alloc
+    size_t kept = 0; // the bytes at the beginning of buffer that are left from the last chunk.
+    while (result < threshold && massageFile.read(&buffer[kept], STREAM_CHUNK_SIZE).gcount() > 0)
+    {
+        const size_t size = kept + (size_t) massageFile.gcount();
+        const std::string_view chunk(buffer.data(), size);
+        for (size_t currentLen: wordsLen)
+        {
+            // only the frames that end in the new bytes - the others were counted already.
+            result += scoreFrames(chunk, kept + 1 > currentLen ? kept + 1 - currentLen : 0,
+                                  currentLen, databaseMap);
+        }
+        kept = size < overlap ? size : overlap;
+        std::memmove(&buffer[0], buffer.data() + size - kept, kept);
+    }
+    if (massageFile.bad())
+    {
+        throw InvalidInput();
+    }
+    return result;
+}
+
+/**
+ * Calculate the score to the given massage file with an Aho-Corasick automaton of the database -
+ * a single pass over the massage finds all the sequences of all lengths. If the database is
+ * empty the massage is not read, like in generateScore().
+ * @param massageFile reference to MappedFile.
+ * @param automaton the automaton built from databaseMap.
+ * @return the score the massage gets based on database.
+ */
+inline int generateAutomatonScore(const MappedFile &massageFile, const AhoCorasick &automaton)
+{
+    if (automaton.empty())
+    {
+        return 0;
+    }
+    if (!massageFile.good())
+    {
+        throw InvalidInput();
+    }
+    return automaton.score(massageFile.view());
+}
+
+/**
+ * Calculate the score to a massage that can only be read forward, like the standard input, with
+ * an Aho-Corasick automaton of the database. The massage is read in chunks of STREAM_CHUNK_SIZE,
+ * and the automaton state carries over from chunk to chunk. The scan stops as soon as the score
+ * reaches the threshold.
+ * This function can throw bad_alloc exception.
+ * @param massageFile reference to istream.
+ * @param automaton the automaton built from databaseMap.
+ * @param threshold the score from which the massage is spam.
+ * @return the score the massage gets based on database, or a score of at least threshold.
+ */
+inline int generateStreamAutomatonScore(std::istream &massageFile,
+                                        const AhoCorasick &automaton, const double &threshold)
+{
+    int result = 0, state = 0;
+    if (automaton.empty())
+    {
+        return result;
+    }
+    if (!massageFile.good())
+    {
+        throw InvalidInput();
+    }
+    vector<char> buffer(STREAM_CHUNK_SIZE); // can throw bad_alloc
+    while (result < threshold && massageFile.read(buffer.data(), STREAM_CHUNK_SIZE).gcount() > 0)
+    {
+        result += automaton.score(std::string_view(buffer.data(), massageFile.gcount()), state);
+    }
+    if (massageFile.bad())
+    {
+        throw InvalidInput();
+    }
+    return result;
+}
+
+/**
+ * Scorer class - scores massages against one loaded database with the chosen engine, so many
+ * massages can be scored without loading the database, or building the automaton, again.
+ * @tparam Database SequenceMap or SequenceImage.
+ */
+template<typename Database>
+class Scorer
+{
+public:
+    /**
+     * Constructor - the automaton is built here if it is the engine.
+     * This function can throw bad_alloc exception.
+     * @param databaseMap reference to HashMap, or to DatabaseImage - it must outlive the Scorer.
+     * @param wordsLen reference to set of size_t - it must outlive the Scorer.
+     * @param engine AUTOMATON_ENGINE or WINDOW_ENGINE.
+     * @param threshold the score from which a massage is spam.
+     * @param segmentThreads the number of threads that score the segments of a big massage at
+     * once - they are started by the first such massage, so a run without one starts none. 1
+     * scores every massage on the calling thread.
+     */
+    Scorer(const Database &databaseMap, const set<size_t> &wordsLen, const string &engine,
+           const double &threshold, const size_t &segmentThreads = 1) :
+            _databaseMap(databaseMap), _wordsLen(wordsLen),
+            _useAutomaton(engine == AUTOMATON_ENGINE), _threshold(threshold),
+            _automaton(_useAutomaton ? AhoCorasick(databaseMap.begin(), databaseMap.end()) :
+                       AhoCorasick()), _segmentThreads(segmentThreads)
+    {}
+
+    /**
+     * Calculate the score to a massage file. A regular file is mapped to memory and scanned
+     * whole - in segments of SEGMENT_SIZE at once, if it is bigger than that and there is more
+     * than one segment thread; anything else (a pipe, the standard input) is streamed in chunks, and can
+     * stop early at the threshold.
+     * This function can throw bad_alloc exception.
+     * @param massagePath the path of the massage, or "-" for the standard input.
+     * @return the score the massage gets based on database, or a score of at least threshold.
+     */
+    int score(const char *massagePath) const
+    {
+        if (MappedFile::mappable(massagePath))
+        {
+            const MappedFile massageFile(massagePath);
+            if (_segmentThreads > 1 && massageFile.good() &&
+                massageFile.view().size() > SEGMENT_SIZE)
+            {
+                return _parallelScore(massageFile.view());
+            }
+            return _useAutomaton ? generateAutomatonScore(massageFile, _automaton) :
+                   generateScore(massageFile, _databaseMap, _wordsLen);
+        }
+        const bool standardInput = std::strcmp(massagePath, STANDARD_INPUT_PATH) == 0;
+        std::ifstream namedFile; // a named pipe, or a path that doesn't open - not good then.
+        if (!standardInput)
+        {
+            namedFile.open(massagePath);
+        }
+        return score(standardInput ? std::cin : namedFile);
+    }
+
+    /**
+     * Calculate the score to a massage stream, in chunks - the scan stops once the score reaches
+     * the threshold.
+     * This function can throw bad_alloc exception.
+     * @param massageFile reference to istream.
+     * @return the score the massage gets based on database, or a score of at least threshold.
+     */
+    int score(std::istream &massageFile) const
+    {
+        return _useAutomaton ? generateStreamAutomatonScore(massageFile, _automaton, _threshold) :
+               generateStreamScore(massageFile, _databaseMap, _wordsLen, _threshold);
+    }
+
+    /**
+     * @param score the score of a massage.
+     * @return true if a massage with that score is spam.
+     */
+    inline bool isSpam(const int &score) const
+    { return score >= _threshold; }
+
+private:
+    const Database &_databaseMap;
+    const set<size_t> &_wordsLen;
+    const bool _useAutomaton;
+    const double _threshold;
+    AhoCorasick _automaton; // empty for the window engine.
+    const size_t _segmentThreads;
+    mutable std::unique_ptr<ThreadPool> _segmentPool; // started by the first big massage.
+    mutable std::once_flag _segmentPoolStarted;
+
+    /**
+     * Score the segments of a massage on the segment pool, and sum their scores. The pool is
+     * started here the first time.
+     * This function can throw bad_alloc exception.
+     * @param massage the massage.
+     * @return the score the massage gets based on database.
+     */
+    int _parallelScore(const std::string_view &massage) const
+    {
+        std::call_once(_segmentPoolStarted, [this]()
+        { _segmentPool.reset(new ThreadPool(_segmentThreads)); });
+        const size_t segments = (massage.size() + SEGMENT_SIZE - 1) / SEGMENT_SIZE;
+        vector<int> scores(segments, 0);
+        try
+        {
+            for (size_t segment = 0; segment < segments; ++segment)
+            {
+                _segmentPool->submit([this, &massage, &scores, segment]()
+                                     {
+                                         const size_t begin = segment * SEGMENT_SIZE;
+                                         const size_t end = std::min(massage.size(),
+                                                                     begin + SEGMENT_SIZE);
+                                         scores[segment] = _scoreSegment(massage, begin, end);
+                                     });
+            }
+        }
+        catch (...)
+        {
+            // the queued segments use massage and scores - they must be done before both go.
+            try
+            {
+                _segmentPool->wait();
+            }
+            catch (...)
+            {
+                // the exception of submit is the one that is thrown.
+            }
+            throw;
+        }
+        _segmentPool->wait();
+        return std::accumulate(scores.begin(), scores.end(), 0);
+    }
+
+    /**
+     * Score the occurrences of a segment of a massage - the ones that start in it with the
+     * window engine, and the ones that end in it with the automaton. Every occurrence is so
+     * counted by one segment exactly. The frames may go on up to (longest sequence length - 1)
+     * bytes after the segment; the automaton starts that many bytes before it, to reach the state
+     * it would be in at the beginning of the segment after a scan of the whole massage.
+     * @param massage the massage.
+     * @param begin the first byte of the segment.
+     * @param end after the last byte of the segment.
+     * @return the score of the segment.
+     */
+    int _scoreSegment(const std::string_view &massage, const size_t &begin,
+                      const size_t &end) const
+    {
+        const size_t overlap = _wordsLen.empty() ? 0 : *_wordsLen.rbegin() - 1;
+        if (_useAutomaton)
+        {
+            const size_t warmUp = begin - std::min(begin, overlap);
+            int state = 0;
+            _automaton.score(massage.substr(warmUp, begin - warmUp), state);
+            return _automaton.score(massage.substr(begin, end - begin), state);
+        }
+        int result = 0;
+        for (size_t currentLen: _wordsLen)
+        {
+            const size_t frameEnd = std::min(massage.size(), end + currentLen - 1);
+            result += scoreFrames(massage.substr(begin, frameEnd - begin), 0, currentLen,
+                                  _databaseMap);
+        }
+        return result;
+    }
+};
+
+#ifdef HASHMAP_STATS
+/**
+ * PhaseClock class - the time of every phase of a run, for the report of reportStats(). Compiled
+ * in only with HASHMAP_STATS.
+ */
+class PhaseClock
+{
+public:
+    /**
+     * End the current phase - it started where the one before it ended, or at the start.
+     * @param phase the name of the phase.
+     */
+    void end(const char *phase)
+    {
+        const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        _phases.emplace_back(phase, std::chrono::duration<double>(now - _last).count());
+        _last = now;
+    }
+
+    /**
+     * Print the phases, one in a line.
+     * @param out the stream to print to.
+     */
+    void print(std::ostream &out) const
+    {
+        for (const std::pair<const char *, double> &phase: _phases)
+        {
+            out << phase.first << ": " << phase.second << " seconds\n";
+        }
+    }
+
+private:
+    std::chrono::steady_clock::time_point _last = std::chrono::steady_clock::now();
+    vector<std::pair<const char *, double>> _phases;
+};
+
+inline PhaseClock phaseClock;
+#endif
+
+/**
+ * End a phase of the run - the time from the end of the previous phase is reported by
+ * reportStats(). Does nothing unless compiled with HASHMAP_STATS.
+ * @param phase the name of the phase.
+ */
+inline void endPhase(const char *phase)
+{
+#ifdef HASHMAP_STATS
+    phaseClock.end(phase);
+#else
+    (void) phase;
+#endif
+}
+
+/**
+ * Print the time of every phase and the statistics of the database to the standard error, if
+ * compiled with HASHMAP_STATS - the verdicts on the standard output don't change.
+ * @param databaseMap reference to HashMap, or to DatabaseImage.
+ */
+template<typename Database>
+void reportStats(const Database &databaseMap)
+{
+#ifdef HASHMAP_STATS
+    phaseClock.print(std::cerr);
+    databaseMap.stats().print(std::cerr);
+#else
+    (void) databaseMap;
+#endif
+}
+
+/**
+ * Load a database - an image is opened in place, and a database file is parsed into a HashMap -
+ * and pass it to an action. Throws InvalidInput if the database is invalid.
+ * This function can throw bad_alloc exception.
+ * @tparam Action callable with (const Database &, const set<size_t> &).
+ * @param databasePath the path of the database file or image.
+ * @param action called with the database and the lengths of its sequences.
+ */
+template<typename Action>
+void withDatabase(const char *databasePath, const Action &action)
+{
+    if (SequenceImage::isImage(databasePath))
+    {
+        const SequenceImage databaseImage(databasePath);
+        if (!databaseImage.good())
+        {
+            throw InvalidInput();
+        }
+        endPhase("open image");
+        action(databaseImage, databaseImage.lengths());
+        return;
+    }
+    const MappedFile databaseFile(databasePath);
+    endPhase("read database");
+    Arena arena; // the database is built in the arena, and freed with it at once.
+    SequenceMap databaseMap{SequenceMap::allocator_type(arena)};
+    set<size_t> wordsLen;
+    createDatabaseMap(databaseFile, databaseMap, wordsLen);
+    endPhase("parse and build");
+    action(databaseMap, wordsLen);
+}
+
+/**
+ * Compile a database file to an image, that later runs open in place instead of parsing the
+ * file. Throws InvalidInput if the database file is invalid or the image can't be written.
+ * This function can throw bad_alloc exception.
+ * @param databasePath the path of the database file.
+ * @param imagePath the path of the image to write.
+ */
+inline void compileDatabase(const char *databasePath, const char *imagePath)
+{
+    const MappedFile databaseFile(databasePath);
+    Arena arena;
+    SequenceMap databaseMap{SequenceMap::allocator_type(arena)};
+    set<size_t> wordsLen;
+    createDatabaseMap(databaseFile, databaseMap, wordsLen);
+    std::ofstream imageFile(imagePath, std::ios::binary | std::ios::trunc);
+    if (!imageFile.is_open() ||
+        !SequenceImage::write(imageFile, databaseMap.begin(), databaseMap.end()))
+    {
+        throw InvalidInput();
+    }
+}
+
+#endif //SPAM_DETECTOR_HPP
@@ -0,0 +1,602 @@
+/**
+ * @file StringHashMap.hpp
+ * @author Aviad Dudkevich
+ * @brief HashMap for string keys - the bytes of all the keys are packed in one array, and every
+ * slot keeps only where its key is, its length and its hash value.
+ */
+#ifndef STRING_HASHMAP_HPP
+#define STRING_HASHMAP_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "HashMap.hpp"
+#include "Prefetch.hpp"
+
+/**
+ * StringHashMap class - a map from strings to values for big string databases. A HashMap of
+ * std::string keeps a 32 bytes string in every pair, and a heap allocation for every key longer
+ * than the small string buffer. Here every key is copied once to the end of a single array of
+ * key bytes, and the table is one array of slots, probed linearly, each of them the offset and
+ * length of its key, the hash value of the key and the value. A lookup compares the key bytes only
+ * when the hash values are equal, and a rehash doesn't hash the keys again.
+ * The keys are std::string_views into the key bytes - they are valid until the next insert, erase
+ * or rehash, like the references at() returns. An erase leaves the bytes of its key unused, and
+ * the key bytes are compacted once more than half of them are unused.
+ * Keys must be shorter than 4GB.
+ * @tparam ValueT type argument for generic value. Assumptions: have copy constructor, default
+ * constructor.
+ * @tparam Hash hash function object of std::string_view, default constructible.
+ * @tparam KeyEqual function object that compares two std::string_views, default constructible.
+ * @tparam Allocator allocator of char, the std::allocator interface - the slots are allocated by
+ * a rebound copy of it.
+ */
+template<typename ValueT, typename Hash = DefaultHash<std::string>,
+        typename KeyEqual = std::equal_to<>, typename Allocator = std::allocator<char>>
+class StringHashMap
+{
+    struct Slot;
+
+    typedef typename std::allocator_traits<Allocator>::template rebind_alloc<char> CharAllocator;
+    typedef typename std::allocator_traits<Allocator>::template rebind_alloc<Slot> SlotAllocator;
+
+public:
+    typedef std::pair<std::string_view, ValueT> value_type;
+    typedef Allocator allocator_type;
+
+    /**
+     * const_iterator class - iterator over the pairs of the map. The pairs are built on the fly,
+     * so the reference is valid until the iterator moves.
+     */
+    class const_iterator
+    {
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef StringHashMap::value_type value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const value_type *pointer;
+        typedef const value_type &reference;
+
+        /**
+         * Constructor given a map and a slot in it.
+         * @param map The map to point to its pairs.
+         * @param slot a full slot, or the capacity of the map for the end.
+         */
+        const_iterator(const StringHashMap &map, const std::size_t &slot) : _map(&map),
+                                                                           _slot(slot)
+        { _load(); }
+
+        /**
+         * * operator.
+         * @return dereference to const pair.
+         */
+        inline const value_type &operator*() const
+        { return _pair; }
+
+        /**
+         * -> operator.
+         * @return const address to the pair.
+         */
+        inline const value_type *operator->() const
+        { return &_pair; }
+
+        /**
+         * prefix operator ++.
+         * @return reference to this.
+         */
+        const_iterator &operator++()
+        {
+            _slot = _map->_nextFull(_slot + 1);
+            _load();
+            return *this;
+        }
+
+        /**
+         * suffix operator ++;
+         * @return reference to const_iterator of the previous pair.
+         */
+        const_iterator operator++(int)
+        {
+            const_iterator temp(*this);
+            operator++();
+            return temp;
+        }
+
+        /**
+         * compare operator.
+         * @param other another const_iterator
+         * @return true if point to the same pair in the same map, false otherwise.
+         */
+        inline bool operator==(const const_iterator &other) const
+        { return _map == other._map && _slot == other._slot; }
+
+        /**
+         * compare operator.
+         * @param other another const_iterator
+         * @return false if point to the same pair in the same map, true otherwise.
+         */
+        inline bool operator!=(const const_iterator &other) const
+        { return !(*this == other); }
+
+    private:
+        const StringHashMap *_map; // the map the const_iterator belong to.
+        std::size_t _slot; // the slot of the pair.
+        value_type _pair; // the pair of the slot.
+
+        /**
+         * Build the pair of the current slot.
+         */
+        void _load()
+        {
+            if (_slot < _map->_slots.size())
+            {
+                const Slot &slot = _map->_slots[_slot];
+                _pair = value_type(_map->_keyOf(slot), slot.value);
+            }
+        }
+    };
+
+    typedef const_iterator iterator;
+
+    /**
+     * Default constructor.
+     */
+    StringHashMap() : StringHashMap(Allocator())
+    {}
+
+    /**
+     * Constructor given an allocator.
+     * @param allocator the allocator of the key bytes and the slots.
+     */
+    explicit StringHashMap(const Allocator &allocator) : _keys(CharAllocator(allocator)),
+                                                         _slots(SlotAllocator(allocator)),
+                                                         _size(0), _unused(0)
+    {}
+
+    /**
+     * @return the allocator of the map.
+     */
+    inline Allocator get_allocator() const
+    { return Allocator(_keys.get_allocator()); }
+
+    /**
+     * @return the number of pairs.
+     */
+    inline int size() const
+    { return (int) _size; }
+
+    /**
+     * @return the number of slots.
+     */
+    inline int capacity() const
+    { return (int) _slots.size(); }
+
+    /**
+     * @return true if there are no pairs.
+     */
+    inline bool empty() const
+    { return _size == 0; }
+
+    /**
+     * @return the number of key bytes, unused ones of erased keys included.
+     */
+    inline std::size_t keyBytes() const
+    { return _keys.size(); }
+
+    /**
+     * Insert a pair, if the key is not in the map.
+     * This function can throw bad_alloc exception.
+     * @param key string.
+     * @param value ValueT value.
+     * @return true if the pair was inserted, false if the key is already in the map.
+     */
+    bool insert(const std::string_view &key, const ValueT &value)
+    {
+        const std::uint64_t hash = Hash{}(key);
+        const std::pair<std::size_t, bool> found = _emplace(key, hash);
+        if (!found.second)
+        {
+            return false;
+        }
+        _slots[found.first].value = value;
+        return true;
+    }
+
+    /**
+     * Insert a pair, or assign the value if the key is already in the map.
+     * This function can throw bad_alloc exception.
+     * @param key string.
+     * @param value ValueT value.
+     * @return true if the pair was inserted, false if the value was assigned.
+     */
+    bool insert_or_assign(const std::string_view &key, const ValueT &value)
+    {
+        const std::pair<std::size_t, bool> found = _emplace(key, Hash{}(key));
+        _slots[found.first].value = value;
+        return found.second;
+    }
+
+    /**
+     * @param key string.
+     * @return reference to the value of the key - a key that is not in the map is inserted with
+     * a default constructed value.
+     */
+    inline ValueT &operator[](const std::string_view &key)
+    { return _slots[_emplace(key, Hash{}(key)).first].value; }
+
+    /**
+     * Erase a pair. The following slots of its probe sequence are shifted back, so the table
+     * never has deleted slots.
+     * @param key string.
+     * @return true if the pair was erased, false if the key is not in the map.
+     */
+    bool erase(const std::string_view &key)
+    {
+        const std::size_t found = _find(key, Hash{}(key));
+        if (found == _slots.size())
+        {
+            return false;
+        }
+        _unused += _slots[found].length;
+        const std::size_t mask = _slots.size() - 1;
+        std::size_t hole = found;
+        for (std::size_t next = (hole + 1) & mask; _slots[next].length != EMPTY_LENGTH;
+             next = (next + 1) & mask)
+        {
+            const std::size_t home = _slots[next].hash & mask;
+            if (((next - home) & mask) >= ((next - hole) & mask)) // the hole is on its way home.
+            {
+                _slots[hole] = std::move(_slots[next]);
+                hole = next;
+            }
+        }
+        _slots[hole] = Slot();
+        --_size;
+        if (_unused > _keys.size() / 2)
+        {
+            _compact();
+        }
+        return true;
+    }
+
+    /**
+     * @param key string.
+     * @return true if the key is in the map.
+     */
+    inline bool containsKey(const std::string_view &key) const
+    { return _find(key, Hash{}(key)) != _slots.size(); }
+
+    /**
+     * @param key string.
+     * @return const reference to the value of the key. Throw out_of_range exception if the key is
+     * not in the map.
+     */
+    const ValueT &at(const std::string_view &key) const
+    { return _slots[_existing(key)].value; }
+
+    /**
+     * @param key string.
+     * @return reference to the value of the key. Throw out_of_range exception if the key is not
+     * in the map.
+     */
+    ValueT &at(const std::string_view &key)
+    { return _slots[_existing(key)].value; }
+
+    /**
+     * @param key string.
+     * @return iterator to the pair with the given key, or end() if there is no such pair.
+     */
+    inline const_iterator find(const std::string_view &key) const
+    { return find(key, Hash{}(key)); }
+
+    /**
+     * Search with a hash value computed by the caller, like HashMap::find(key, hash).
+     * @param key string.
+     * @param hash the hash value of key - must be equal to what Hash returns for it.
+     * @return iterator to the pair with the given key, or end() if there is no such pair.
+     */
+    inline const_iterator find(const std::string_view &key, const std::size_t &hash) const
+    { return const_iterator(*this, _find(key, hash)); }
+
+    /**
+     * Start loading the home slot of the given hash value, like HashMap::prefetch(). The key
+     * bytes are read only if the hash values are equal, so they are not prefetched.
+     * @param hash the hash value of a key.
+     */
+    inline void prefetch(const std::size_t &hash) const
+    {
+        if (!_slots.empty())
+        {
+            prefetchRead(_slots.data() + (hash & (_slots.size() - 1)));
+        }
+    }
+
+    /**
+     * @return iterator to the first pair.
+     */
+    inline const_iterator begin() const
+    { return const_iterator(*this, _nextFull(0)); }
+
+    /**
+     * @return iterator to after the last pair.
+     */
+    inline const_iterator end() const
+    { return const_iterator(*this, _slots.size()); }
+
+    /**
+     * Make room for a number of pairs, and of key bytes, so adding them doesn't rehash or move
+     * the key bytes.
+     * This function can throw bad_alloc exception.
+     * @param count the number of pairs the map should hold.
+     * @param keyBytes the number of key bytes the map should hold.
+     */
+    void reserve(const long &count, const std::size_t &keyBytes = 0)
+    {
+        _keys.reserve(keyBytes);
+        std::size_t newCapacity = INITIAL_CAPACITY;
+        while ((double) count > newCapacity * DEFAULT_UPPER_LOAD_FACTOR)
+        {
+            newCapacity *= 2;
+        }
+        if (newCapacity > _slots.size())
+        {
+            _rehash(newCapacity);
+        }
+    }
+
+    /**
+     * @return the lengths of the buckets - the pairs with the same home slot - and, if compiled
+     * with HASHMAP_STATS, the number of searches and rehashes since the map was constructed.
+     */
+    HashMapStats stats() const
+    {
+        HashMapStats result{(long) _size, (long) _slots.size(),
+                            std::vector<long>(STATS_HISTOGRAM_SIZE, 0), 0, false, 0, 0, 0, 0};
+        std::vector<long> homes(_slots.size(), 0);
+        for (const Slot &slot: _slots)
+        {
+            if (slot.length != EMPTY_LENGTH)
+            {
+                ++homes[slot.hash & (_slots.size() - 1)];
+            }
+        }
+        for (const long &length: homes)
+        {
+            result.addBuckets(length, 1);
+        }
+#ifdef HASHMAP_STATS
+        _stats.addTo(result);
+#endif
+        return result;
+    }
+
+    /**
+     * Erase all the pairs. The memory is kept for new pairs.
+     */
+    void clear()
+    {
+        std::fill(_slots.begin(), _slots.end(), Slot());
+        _keys.clear();
+        _size = 0;
+        _unused = 0;
+    }
+
+private:
+    static constexpr std::uint32_t EMPTY_LENGTH = ~(std::uint32_t) 0;
+
+    /**
+     * A slot of the table - empty if its length is EMPTY_LENGTH.
+     */
+    struct Slot
+    {
+        std::uint64_t hash = 0; // the hash value of the key.
+        std::uint64_t offset = 0; // the first byte of the key in _keys.
+        std::uint32_t length = EMPTY_LENGTH;
+        ValueT value = ValueT();
+    };
+
+    std::vector<char, CharAllocator> _keys; // the bytes of all the keys.
+    std::vector<Slot, SlotAllocator> _slots; // the table, a power of 2 slots (or none).
+    std::size_t _size;
+    std::size_t _unused; // the bytes in _keys of keys that were erased.
+#ifdef HASHMAP_STATS
+    StatsCounters _stats; // the searches and rehashes of this object - not copied.
+#endif
+
+    /**
+     * @param slot a full slot.
+     * @return the key of the slot.
+     */
+    inline std::string_view _keyOf(const Slot &slot) const
+    { return std::string_view(_keys.data() + slot.offset, slot.length); }
+
+    /**
+     * Search a key, and count the search if compiled with HASHMAP_STATS.
+     * @param key string.
+     * @param hash the hash value of key.
+     * @return the slot of the key, or the capacity if the key is not in the map.
+     */
+    inline std::size_t _find(const std::string_view &key, const std::uint64_t &hash) const
+    {
+        const std::size_t found = _probe(key, hash);
+#ifdef HASHMAP_STATS
+        _stats.search(found != _slots.size());
+#endif
+        return found;
+    }
+
+    /**
+     * @param key string.
+     * @param hash the hash value of key.
+     * @return the slot of the key, or the capacity if the key is not in the map.
+     */
+    std::size_t _probe(const std::string_view &key, const std::uint64_t &hash) const
+    {
+        if (_slots.empty())
+        {
+            return 0;
+        }
+        const std::size_t mask = _slots.size() - 1;
+        for (std::size_t i = hash & mask;; i = (i + 1) & mask)
+        {
+            const Slot &slot = _slots[i];
+            if (slot.length == EMPTY_LENGTH)
+            {
+                return _slots.size();
+            }
+            if (slot.hash == hash && slot.length == key.size() && KeyEqual{}(_keyOf(slot), key))
+            {
+                return i;
+            }
+        }
+    }
+
+    /**
+     * @param key string.
+     * @return the slot of the key. Throw out_of_range exception if the key is not in the map.
+     */
+    std::size_t _existing(const std::string_view &key) const
+    {
+        const std::size_t found = _find(key, Hash{}(key));
+        if (found == _slots.size())
+        {
+            throw std::out_of_range(KEY_DOSENT_EXIST_ERROR);
+        }
+        return found;
+    }
+
+    /**
+     * Find a key, or add it with a default constructed value. The key may point into the key
+     * bytes of this map.
+     * This function can throw bad_alloc exception - the map doesn't change then.
+     * @param key string.
+     * @param hash the hash value of key.
+     * @return the slot of the key, and true if it was added.
+     */
+    std::pair<std::size_t, bool> _emplace(const std::string_view &key, const std::uint64_t &hash)
+    {
+        const std::size_t found = _probe(key, hash);
+        if (found != _slots.size())
+        {
+            return std::make_pair(found, false);
+        }
+        if ((double) (_size + 1) > _slots.size() * DEFAULT_UPPER_LOAD_FACTOR)
+        {
+            _rehash(_slots.empty() ? INITIAL_CAPACITY : _slots.size() * 2);
+        }
+        const std::size_t offset = _keys.size();
+        if (_keys.capacity() - offset < key.size())
+        {
+            // key may be in _keys itself - copy it before the bytes move.
+            const std::string copy(key);
+            _keys.insert(_keys.end(), copy.begin(), copy.end());
+        }
+        else
+        {
+            _keys.insert(_keys.end(), key.begin(), key.end());
+        }
+        const std::size_t mask = _slots.size() - 1;
+        std::size_t i = hash & mask;
+        while (_slots[i].length != EMPTY_LENGTH)
+        {
+            i = (i + 1) & mask;
+        }
+        _slots[i].hash = hash;
+        _slots[i].offset = offset;
+        _slots[i].length = (std::uint32_t) key.size();
+        ++_size;
+        return std::make_pair(i, true);
+    }
+
+    /**
+     * Move the pairs to a table with a new number of slots, timed if compiled with
+     * HASHMAP_STATS.
+     * This function can throw bad_alloc exception - the map doesn't change then.
+     * @param newCapacity a power of 2, big enough for all the pairs.
+     */
+    void _rehash(const std::size_t &newCapacity)
+    {
+#ifdef HASHMAP_STATS
+        _stats.rehash([this, &newCapacity]()
+                      { _moveSlots(newCapacity); });
+#else
+        _moveSlots(newCapacity);
+#endif
+    }
+
+    /**
+     * Move the pairs to a table with a new number of slots, by the hash values they keep.
+     * @param newCapacity a power of 2, big enough for all the pairs.
+     */
+    void _moveSlots(const std::size_t &newCapacity)
+    {
+        std::vector<Slot, SlotAllocator> slots(newCapacity, Slot(), _slots.get_allocator());
+        const std::size_t mask = newCapacity - 1;
+        for (Slot &slot: _slots)
+        {
+            if (slot.length != EMPTY_LENGTH)
+            {
+                std::size_t i = slot.hash & mask;
+                while (slots[i].length != EMPTY_LENGTH)
+                {
+                    i = (i + 1) & mask;
+                }
+                slots[i] = std::move(slot);
+            }
+        }
+        _slots.swap(slots);
+    }
+
+    /**
+     * Copy the keys that are in the map to new key bytes, without the unused bytes of erased keys.
+     * If there is no memory for the copy, the unused bytes are kept.
+     */
+    void _compact()
+    {
+        try
+        {
+            std::vector<char, CharAllocator> keys(_keys.get_allocator());
+            keys.reserve(_keys.size() - _unused);
+            for (Slot &slot: _slots)
+            {
+                if (slot.length != EMPTY_LENGTH)
+                {
+                    const std::size_t offset = keys.size();
+                    keys.insert(keys.end(), _keys.begin() + slot.offset,
+                                _keys.begin() + slot.offset + slot.length);
+                    slot.offset = offset;
+                }
+            }
+            _keys.swap(keys);
+            _unused = 0;
+        }
+        catch (const std::bad_alloc &)
+        {
+            // nothing was changed - the next erase tries again.
+        }
+    }
+
+    /**
+     * @param slot a slot, or the capacity.
+     * @return the first full slot from the given one, or the capacity if there is none.
+     */
+    std::size_t _nextFull(std::size_t slot) const
+    {
+        while (slot < _slots.size() && _slots[slot].length == EMPTY_LENGTH)
+        {
+            ++slot;
+        }
+        return slot;
+    }
+};
+
+#endif //STRING_HASHMAP_HPP
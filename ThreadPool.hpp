@@ -0,0 +1,240 @@
+/**
+ * @file ThreadPool.hpp
+ * @author Aviad Dudkevich
+ * @brief Fixed size pool of worker threads with a task queue for every worker, and work stealing
+ * between the queues.
+ */
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * ThreadPool class - runs tasks on a fixed number of worker threads. Every worker has a queue of
+ * its own: tasks submitted from outside the pool are dealt to the queues in turn, and a task
+ * submitted by a worker goes to its own queue. A worker runs the newest of the tasks it submitted
+ * itself, or else the oldest task dealt to it - so the tasks from outside start in the order they
+ * were submitted - and when its queue is empty steals the oldest task of another queue, so a
+ * worker that is stuck on a long task doesn't hold back the tasks behind it.
+ * A task that throws doesn't stop the pool - the first exception is thrown again by wait().
+ */
+class ThreadPool
+{
+public:
+    /**
+     * Constructor given the number of workers.
+     * @param threads the number of worker threads, at least 1.
+     */
+    explicit ThreadPool(const std::size_t &threads) : _next(0), _queued(0), _pending(0),
+                                                      _stopping(false)
+    {
+        const std::size_t count = threads == 0 ? 1 : threads;
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            _queues.emplace_back(new Queue());
+        }
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            _workers.emplace_back(&ThreadPool::_run, this, i);
+        }
+    }
+
+    ThreadPool(const ThreadPool &other) = delete;
+
+    ThreadPool &operator=(const ThreadPool &other) = delete;
+
+    /**
+     * Destructor - run the tasks that are left, and join the workers.
+     */
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stopping = true;
+        }
+        _wakeUp.notify_all();
+        for (std::thread &worker: _workers)
+        {
+            worker.join();
+        }
+    }
+
+    /**
+     * @return the number of worker threads.
+     */
+    inline std::size_t size() const
+    { return _workers.size(); }
+
+    /**
+     * Add a task.
+     * @param task the task to run on one of the workers.
+     */
+    void submit(std::function<void()> task)
+    {
+        const std::size_t self = _workerIndex();
+        Queue &queue = *_queues[self == NOT_A_WORKER ? _deal() : self];
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            (self == NOT_A_WORKER ? queue.dealt : queue.spawned).push_back(std::move(task));
+        }
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            ++_queued;
+            ++_pending;
+        }
+        _wakeUp.notify_one();
+    }
+
+    /**
+     * Wait until all the tasks that were submitted are done. Must not be called by a worker.
+     * Throws the first exception a task threw since the last call, if any.
+     */
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _idle.wait(lock, [this]
+        { return _pending == 0; });
+        if (_error != nullptr)
+        {
+            std::exception_ptr error = _error;
+            _error = nullptr;
+            std::rethrow_exception(error);
+        }
+    }
+
+private:
+    static constexpr std::size_t NOT_A_WORKER = ~(std::size_t) 0;
+
+    /**
+     * The task queue of a worker.
+     */
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<std::function<void()>> dealt; // submitted from outside the pool.
+        std::deque<std::function<void()>> spawned; // submitted by the worker itself.
+    };
+
+    std::vector<std::unique_ptr<Queue>> _queues; // the queue of every worker.
+    std::vector<std::thread> _workers;
+    std::mutex _mutex; // guards the counters, _stopping and _error.
+    std::condition_variable _wakeUp; // a task was queued, or the pool is stopping.
+    std::condition_variable _idle; // all the tasks are done.
+    std::size_t _next; // the queue the next task from outside goes to.
+    std::size_t _queued; // tasks that are queued and not taken yet.
+    std::size_t _pending; // tasks that are queued or running.
+    bool _stopping;
+    std::exception_ptr _error; // the first exception of a task.
+
+    /**
+     * @return the index of the worker that calls, of this pool - NOT_A_WORKER if it isn't one.
+     */
+    std::size_t &_workerIndex() const
+    {
+        thread_local std::size_t index = NOT_A_WORKER;
+        thread_local const ThreadPool *pool = nullptr;
+        if (pool != this)
+        {
+            pool = this;
+            index = NOT_A_WORKER;
+        }
+        return index;
+    }
+
+    /**
+     * @return the queue for a task submitted from outside the pool.
+     */
+    std::size_t _deal()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        const std::size_t queue = _next;
+        _next = (_next + 1) % _queues.size();
+        return queue;
+    }
+
+    /**
+     * Take a task - from the worker's own queue the newest task it submitted itself, or else the
+     * oldest task dealt to it; from another queue the oldest task, dealt ones first.
+     * @param self the index of the worker.
+     * @param task set to the task that was taken.
+     * @return true if a task was taken.
+     */
+    bool _take(const std::size_t &self, std::function<void()> &task)
+    {
+        for (std::size_t i = 0; i < _queues.size(); ++i)
+        {
+            Queue &queue = *_queues[(self + i) % _queues.size()];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (i == 0 && !queue.spawned.empty())
+            {
+                task = std::move(queue.spawned.back());
+                queue.spawned.pop_back();
+                return true;
+            }
+            std::deque<std::function<void()>> &tasks = queue.dealt.empty() ? queue.spawned :
+                                                       queue.dealt;
+            if (!tasks.empty())
+            {
+                task = std::move(tasks.front());
+                tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * The loop of a worker - take tasks and run them until the pool stops and no task is left.
+     * @param self the index of the worker.
+     */
+    void _run(const std::size_t self)
+    {
+        _workerIndex() = self;
+        std::function<void()> task;
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _wakeUp.wait(lock, [this]
+                { return _queued > 0 || _stopping; });
+                if (_queued == 0)
+                {
+                    return; // stopping, and nothing is left.
+                }
+                --_queued; // this worker takes one of the queued tasks.
+            }
+            while (!_take(self, task))
+            {
+                std::this_thread::yield(); // the task is still being pushed to its queue.
+            }
+            try
+            {
+                task();
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                if (_error == nullptr)
+                {
+                    _error = std::current_exception();
+                }
+            }
+            task = nullptr;
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (--_pending == 0)
+            {
+                _idle.notify_all();
+            }
+        }
+    }
+};
+
+#endif //THREAD_POOL_HPP